@@ -0,0 +1,1218 @@
+/*******************************************************************************
+ * @file    :   decoder_bench.c
+ * @brief   :   Host replay benchmark for the DCC bit receiver
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+/**
+ * Feeds interrupt_funct() with a trace of half-bit durations, exactly as
+ * EXTI4_15_IRQHandler would, drains the packet queue after every edge as the
+ * main loop would, and reports the throughput of the receiver and the cost of
+ * every path through its state machine.
+ *
+ * The trace is either synthesized (a mix of packets for us, for other
+ * locomotives and idle packets, with optional jitter) or read from a text file
+ * containing one half-bit duration in µs per line; '#' starts a comment.
+ *
+ * Usage: decoder_bench [-n packets] [-j jitter_us] [-f foreign_percent]
+ *                      [-p preamble_bits] [-s seed] [-R repeats]
+ *                      [-r trace_file] [-w trace_file]
+ *
+ * The cost of an edge is the minimum over the repeated replays, which filters
+ * out preemption and cache misses of the host; the worst case of a path is
+ * then the most expensive edge that took it.
+ *
+ * The same trace is also replayed through the if/else cascade the table-driven
+ * receiver replaced (legacy_decoder.c): both must output the same packets, and
+ * their costs are compared.
+ *
+ * A further replay goes through the capture front end instead: timestamps are
+ * pushed with edge_capture() as EXTI4_15_IRQHandler does, and edge_drain() is
+ * run whenever PendSV gets pended, TIM2 updates included.
+ *
+ * Host timings are not M0+ cycles: use them to compare two versions of the
+ * receiver against each other, not as an absolute ISR budget: only the
+ * target's clock_stats give cycles.
+ *
+ * The last passes cut the power at every program of the journaled CV store
+ * and right after every service mode ACK, see bench_journal() and
+ * bench_service(), then check the function outputs, the speed table and the
+ * repeat cache against the CVs, see bench_outputs(). The bench exits with 1
+ * if any cut loses a CV or any check fails.
+ */
+
+#include "stm32l0xx_hal.h"
+#include "decoder.h"
+#include "config.h"
+#include "cv.h"
+#include "edge_capture.h"
+#include "function_map.h"
+#include "lights.h"
+#include "speed_table.h"
+#include "service_mode.h"
+#include "legacy_decoder.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+extern const uint32_t ONE_DELTA, ZERO_COMPL;
+
+#define HALF_ONE	58	/* µs, nominal half 1-bit sent by a command station */
+#define HALF_ZERO	100	/* µs, nominal half 0-bit sent by a command station */
+
+enum bench_path {
+	PATH_ONE_FIRST,
+	PATH_ONE_PREAMBLE,
+	PATH_ONE_DATA,
+	PATH_ONE_END,
+	PATH_ONE_ASYM,
+	PATH_ZERO_FIRST,
+	PATH_ZERO_DATA,
+	PATH_ZERO_BYTE,
+	PATH_ZERO_PREAMBLE,
+	PATH_ZERO_SHORT,
+	PATH_ZERO_LONG,
+	PATH_INVALID,
+	PATH_DISPATCH,
+	PATH_COUNT
+};
+
+static const char *const path_names[PATH_COUNT] = {
+	"1: first half",
+	"1: preamble bit",
+	"1: data bit",
+	"1: packet end (queue)",
+	"1: asymmetric, reset",
+	"0: first half",
+	"0: data bit",
+	"0: byte end",
+	"0: preamble end",
+	"0: short preamble, reset",
+	"0: bit too long, reset",
+	"invalid, reset",
+	"main loop: decode",
+};
+
+struct path_stats {
+	uint64_t count;
+	uint64_t total_ns;
+	uint64_t max_ns;
+};
+
+struct trace {
+	uint16_t *T;
+	size_t len, cap;
+	size_t packets;
+};
+
+static void trace_push(struct trace *tr, uint16_t T)
+{
+	if (tr->len == tr->cap) {
+		tr->cap = tr->cap ? tr->cap * 2 : 4096;
+		tr->T = realloc(tr->T, tr->cap * sizeof(*tr->T));
+		if (!tr->T) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	tr->T[tr->len++] = T;
+}
+
+static uint32_t rng_state;
+
+static uint32_t rng(void)
+{
+	/* xorshift32, deterministic across hosts */
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return rng_state;
+}
+
+static uint16_t jittered(uint16_t T, unsigned jitter)
+{
+	if (jitter == 0)
+		return T;
+
+	return T - jitter + rng() % (2 * jitter + 1);
+}
+
+static void push_bit(struct trace *tr, int bit, unsigned jitter)
+{
+	uint16_t half = bit ? HALF_ONE : HALF_ZERO;
+
+	trace_push(tr, jittered(half, jitter));
+	trace_push(tr, jittered(half, jitter));
+}
+
+static void push_packet(struct trace *tr, const uint8_t *bytes, uint8_t len,
+			unsigned preamble, unsigned jitter)
+{
+	uint8_t sum = 0;
+
+	for (unsigned i = 0; i < preamble; i++)
+		push_bit(tr, 1, jitter);
+
+	for (uint8_t i = 0; i <= len; i++) {
+		uint8_t b = (i < len) ? bytes[i] : sum;
+
+		sum ^= b;
+		push_bit(tr, 0, jitter);
+		for (int j = 7; j >= 0; j--)
+			push_bit(tr, (b >> j) & 1, jitter);
+	}
+
+	/* Packet end bit */
+	push_bit(tr, 1, jitter);
+	tr->packets++;
+}
+
+static void synth_trace(struct trace *tr, size_t n, unsigned jitter,
+			unsigned foreign, unsigned preamble)
+{
+	uint8_t pkt[4];
+	uint8_t speed = DCC_SDIF | 0x08, fg1 = DCC_FG1I | 0x10;
+
+	for (size_t i = 0; i < n; i++) {
+		uint32_t r = rng();
+
+		if (r % 100 < foreign) {
+			/* Refresh for another locomotive, short or long address */
+			if (r & 0x100) {
+				pkt[0] = 0xc0 | ((r >> 9) & 0x27);
+				pkt[1] = r >> 16;
+				pkt[2] = 0x3f;
+				pkt[3] = (r >> 24) | 0x02;
+				push_packet(tr, pkt, 4, preamble, jitter);
+			} else {
+				pkt[0] = 4 + (r >> 9) % 120;
+				pkt[1] = DCC_SDIF | ((r >> 16) & 0x1f);
+				push_packet(tr, pkt, 2, preamble, jitter);
+			}
+		} else if (r % 100 < foreign + (100 - foreign) / 2) {
+			pkt[0] = DCC_IDLEADDR;
+			pkt[1] = 0x00;
+			push_packet(tr, pkt, 2, preamble, jitter);
+		} else {
+			/*
+			 * Refresh for us: speed or function group one, the
+			 * throttle changing one of them every 16 packets or so
+			 */
+			if ((r >> 12) % 16 == 0)
+				speed = DCC_SDIF | ((r >> 16) & 0x1f);
+			if ((r >> 12) % 16 == 1)
+				fg1 = DCC_FG1I | ((r >> 16) & 0x1f);
+			pkt[0] = DCC_ADDRESS;
+			pkt[1] = (r & 0x100) ? fg1 : speed;
+			push_packet(tr, pkt, 2, preamble, jitter);
+		}
+	}
+}
+
+static void read_trace(struct trace *tr, const char *path)
+{
+	FILE *f = fopen(path, "r");
+	char line[128];
+
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		char *end;
+		unsigned long T;
+
+		line[strcspn(line, "#")] = '\0';
+		T = strtoul(line, &end, 0);
+		if (end == line)
+			continue;
+		trace_push(tr, T > 65535 ? 65535 : T);
+	}
+
+	fclose(f);
+}
+
+static void write_trace(const struct trace *tr, const char *path)
+{
+	FILE *f = fopen(path, "w");
+
+	if (!f) {
+		perror(path);
+		exit(1);
+	}
+
+	fprintf(f, "# DCC half-bit durations in us, %zu edges\n", tr->len);
+	for (size_t i = 0; i < tr->len; i++)
+		fprintf(f, "%u\n", tr->T[i]);
+
+	fclose(f);
+}
+
+/**
+ * Names the path an edge is about to take through interrupt_funct(), from the
+ * receiver state before the call.
+ */
+static enum bench_path classify(uint16_t T)
+{
+	uint8_t half = dec1.state & RX_HALF;
+	uint8_t phase = dec1.state & RX_PHASE;
+
+	switch (pulse_class(T)) {
+	case PULSE_ONE:
+		if (half != RX_H1)
+			return PATH_ONE_FIRST;
+		if (abs(T - dec1.T_prev) > ONE_DELTA)
+			return PATH_ONE_ASYM;
+		if (phase == RX_PRE)
+			return PATH_ONE_PREAMBLE;
+		return (phase == RX_SEP) ? PATH_ONE_END : PATH_ONE_DATA;
+	case PULSE_ZERO:
+		if (half != RX_H0)
+			return PATH_ZERO_FIRST;
+		if (T + dec1.T_prev > ZERO_COMPL)
+			return PATH_ZERO_LONG;
+		if (phase == RX_PRE)
+			return (dec1.N >= PREAMBLE_MIN) ? PATH_ZERO_PREAMBLE
+							: PATH_ZERO_SHORT;
+		return (phase == RX_SEP) ? PATH_ZERO_BYTE : PATH_ZERO_DATA;
+	default:
+		return PATH_INVALID;
+	}
+}
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static uint64_t timer_overhead_ns(void)
+{
+	uint64_t best = UINT64_MAX;
+
+	for (int i = 0; i < 10000; i++) {
+		uint64_t t0 = now_ns();
+		uint64_t t1 = now_ns();
+
+		if (t1 - t0 < best)
+			best = t1 - t0;
+	}
+
+	return best;
+}
+
+static void reset_receiver(void)
+{
+	memset(&dec1, 0, sizeof(dec1));
+	memset(&pq1, 0, sizeof(pq1));
+	decoder_init();
+	dcc_cache_flush();
+}
+
+static uint64_t sub_overhead(uint64_t d, uint64_t overhead)
+{
+	return (d > overhead) ? d - overhead : 0;
+}
+
+struct packet_log {
+	uint8_t *buf;
+	size_t len, cap, packets;
+};
+
+static struct packet_log legacy_log;
+
+static void log_packet(struct packet_log *log, const uint8_t *bytes,
+		       uint8_t len)
+{
+	if (log->len + len + 1 > log->cap) {
+		log->cap = log->cap ? log->cap * 2 : 65536;
+		log->buf = realloc(log->buf, log->cap);
+		if (!log->buf) {
+			perror("realloc");
+			exit(1);
+		}
+	}
+	log->buf[log->len++] = len;
+	memcpy(log->buf + log->len, bytes, len);
+	log->len += len;
+	log->packets++;
+}
+
+/*
+ * The cascade hands over every packet; keep those the table-driven receiver
+ * does not drop by address, following the rules of decode(). An address byte
+ * is only checked once another byte follows it.
+ */
+static int legacy_wanted(const uint8_t *bytes, uint8_t len)
+{
+	uint16_t key = bytes[0];
+
+	if (len < 2 || bytes[0] == DCC_BROADCAST)
+		return 1;
+	if (bytes[0] == DCC_IDLEADDR)
+		return 0;
+	if ((bytes[0] & 0xc0u) == 0xc0u) {
+		if (len < 3)
+			return 1;
+		key = DCC_ADDR_LONG | ((bytes[0] & 0x3fu) << 8u) | bytes[1];
+	}
+
+	return dcc_addr_match(key) != DCC_ADDR_OTHER;
+}
+
+static void legacy_packet(const uint8_t *bytes, uint8_t len)
+{
+	if (legacy_wanted(bytes, len))
+		log_packet(&legacy_log, bytes, len);
+}
+
+/* Timed runs: the same copy pq_push does for the table-driven receiver */
+static void legacy_sink(const uint8_t *bytes, uint8_t len)
+{
+	static struct dcc_packet last;
+
+	memcpy(last.bytes, bytes, len);
+	last.len = len;
+}
+
+static void drain_to_log(struct packet_log *log)
+{
+	const struct dcc_packet *p;
+
+	while ((p = pq_peek(&pq1)) != NULL) {
+		if (log)
+			log_packet(log, p->bytes, p->len);
+		pq_pop(&pq1);
+	}
+}
+
+static void bench_legacy(const struct trace *tr, unsigned repeats,
+			 uint64_t overhead)
+{
+	struct packet_log new_log = { 0 };
+	uint32_t *c_new = malloc(tr->len * sizeof(*c_new));
+	uint32_t *c_old = malloc(tr->len * sizeof(*c_old));
+	uint64_t t_new = UINT64_MAX, t_old = UINT64_MAX;
+	uint64_t max_new = 0, max_old = 0;
+
+	if (!c_new || !c_old) {
+		perror("malloc");
+		exit(1);
+	}
+
+	/* Output of both receivers */
+	reset_receiver();
+	legacy_log.len = legacy_log.packets = 0;
+	legacy_init(legacy_packet);
+	for (size_t i = 0; i < tr->len; i++) {
+		interrupt_funct(tr->T[i]);
+		drain_to_log(&new_log);
+		legacy_interrupt_funct(tr->T[i]);
+	}
+
+	for (unsigned r = 0; r < repeats; r++) {
+		uint64_t t0;
+
+		legacy_init(legacy_sink);
+		t0 = now_ns();
+		for (size_t i = 0; i < tr->len; i++)
+			legacy_interrupt_funct(tr->T[i]);
+		t0 = now_ns() - t0;
+		if (t0 < t_old)
+			t_old = t0;
+
+		reset_receiver();
+		t0 = now_ns();
+		for (size_t i = 0; i < tr->len; i++) {
+			interrupt_funct(tr->T[i]);
+			if (pq1.head != pq1.tail)
+				pq_pop(&pq1);
+		}
+		t0 = now_ns() - t0;
+		if (t0 < t_new)
+			t_new = t0;
+
+		/* Per edge, for the worst case of each receiver */
+		legacy_init(legacy_sink);
+		reset_receiver();
+		for (size_t i = 0; i < tr->len; i++) {
+			uint64_t s = now_ns();
+			legacy_interrupt_funct(tr->T[i]);
+			uint64_t d = sub_overhead(now_ns() - s, overhead);
+
+			if (r == 0 || d < c_old[i])
+				c_old[i] = d;
+
+			s = now_ns();
+			interrupt_funct(tr->T[i]);
+			d = sub_overhead(now_ns() - s, overhead);
+			drain_to_log(NULL);
+
+			if (r == 0 || d < c_new[i])
+				c_new[i] = d;
+		}
+	}
+
+	for (size_t i = 0; i < tr->len; i++) {
+		if (c_new[i] > max_new)
+			max_new = c_new[i];
+		if (c_old[i] > max_old)
+			max_old = c_old[i];
+	}
+
+	printf("\ntable-driven receiver vs if/else cascade\n");
+	if (new_log.len == legacy_log.len &&
+	    memcmp(new_log.buf, legacy_log.buf, new_log.len) == 0)
+		printf("packets          : identical (%zu)\n", new_log.packets);
+	else
+		printf("packets          : DIFFERENT (%zu vs %zu)\n",
+		       new_log.packets, legacy_log.packets);
+	printf("ns/edge          : %.2f vs %.2f\n",
+	       (double) t_new / tr->len, (double) t_old / tr->len);
+	printf("worst edge       : %llu ns vs %llu ns\n",
+	       (unsigned long long) max_new, (unsigned long long) max_old);
+
+	free(new_log.buf);
+	free(c_old);
+	free(c_new);
+}
+
+static void bench_capture(const struct trace *tr, unsigned repeats,
+			  uint64_t overhead)
+{
+	uint32_t *isr = malloc(tr->len * sizeof(*isr));
+	uint32_t *drain = calloc(tr->len, sizeof(*drain));
+	uint64_t isr_total = 0, isr_max = 0, drain_total = 0, drain_max = 0;
+	uint64_t signal_us = 0, drains = 0, received = 0;
+
+	if (!isr || !drain) {
+		perror("malloc");
+		exit(1);
+	}
+
+	for (unsigned r = 0; r < repeats; r++) {
+		uint32_t now = 0;
+
+		reset_receiver();
+		memset(&er1, 0, sizeof(er1));
+		er1.sync = true;
+		received = 0;
+
+		for (size_t i = 0; i < tr->len; i++) {
+			uint32_t next = now + tr->T[i];
+
+			/* TIM2 update events between the two edges */
+			for (uint32_t u = (now >> 16) + 1; u <= (next >> 16); u++)
+				edge_timer_update();
+			now = next;
+
+			uint64_t s = now_ns();
+			edge_capture(now);
+			uint64_t d = sub_overhead(now_ns() - s, overhead);
+
+			if (r == 0 || d < isr[i])
+				isr[i] = d;
+
+			if (!(SCB->ICSR & SCB_ICSR_PENDSVSET_Msk))
+				continue;
+
+			SCB->ICSR = 0;
+			s = now_ns();
+			edge_drain();
+			d = sub_overhead(now_ns() - s, overhead);
+
+			if (r == 0 || d < drain[i])
+				drain[i] = d;
+
+			received += (uint8_t) (pq1.head - pq1.tail);
+			decoder_poll();
+		}
+
+		/* Edges left in the ring, as the next TIM2 update would */
+		edge_drain();
+		received += (uint8_t) (pq1.head - pq1.tail);
+		decoder_poll();
+		signal_us = now;
+	}
+
+	for (size_t i = 0; i < tr->len; i++) {
+		isr_total += isr[i];
+		if (isr[i] > isr_max)
+			isr_max = isr[i];
+		if (drain[i] == 0)
+			continue;
+		drains++;
+		drain_total += drain[i];
+		if (drain[i] > drain_max)
+			drain_max = drain[i];
+	}
+
+	printf("\ncapture front end (ring of %u edges)\n", EDGE_RING_LEN);
+	printf("packets received : %llu\n", (unsigned long long) received);
+	printf("edge ISR         : %.1f ns avg, %llu ns max\n",
+	       (double) isr_total / tr->len, (unsigned long long) isr_max);
+	printf("batch drains     : %llu, %.1f ns avg, %llu ns max\n",
+	       (unsigned long long) drains,
+	       drains ? (double) drain_total / drains : 0.0,
+	       (unsigned long long) drain_max);
+	printf("receiver runs/s  : %.0f batches (edge ISR %.0f/s, store only)\n",
+	       drains * 1e6 / signal_us, tr->len * 1e6 / signal_us);
+	printf("ring overruns    : %u\n", er1.overruns);
+
+	free(drain);
+	free(isr);
+}
+
+/**
+ * Journaled CV store: bursts of writes to the speed table, committed by
+ * cv_commit_poll() as it runs in the main loop, through several compactions.
+ * The data EEPROM is saved after every program, so that a power cut can then
+ * be replayed at each of them. The word being programmed is left with part of
+ * its bits, as the NVM leaves it: erased, half of the old value (cut while
+ * erasing) or half of the new one (cut while programming). reload_all_cvs()
+ * must rebuild the CVs as they were right before that program or right after
+ * it.
+ */
+#define JOURNAL_CV_FIRST	67	/* speed table, writable over 0-255 */
+#define JOURNAL_CV_COUNT	28
+#define JOURNAL_BURSTS		60
+#define JOURNAL_BURST_MAX	6
+#define JOURNAL_PROGRAMS_MAX	2048
+
+#define JOURNAL_WORDS		(DATA_EEPROM_BANK_SIZE / 4)
+#define JOURNAL_PAGE_WORDS	(CV_PAGE_SIZE / 4)
+
+/* CVs rebuilt from an image of the data EEPROM, as at power up */
+static void journal_recover(const uint32_t *img, uint8_t *cvs)
+{
+	memcpy((void *) DATA_EEPROM_BASE, img, DATA_EEPROM_BANK_SIZE);
+	reload_all_cvs();
+
+	for (uint16_t num = 1; num <= LAST_CV_NUM; num++)
+		cvs[num - 1] = read_cv(num);
+}
+
+static bool bench_journal(void)
+{
+	uint32_t (*img)[JOURNAL_WORDS] = malloc(JOURNAL_PROGRAMS_MAX *
+						sizeof(*img));
+	uint8_t (*rec)[LAST_CV_NUM] = malloc(JOURNAL_PROGRAMS_MAX *
+					     sizeof(*rec));
+	uint8_t want[LAST_CV_NUM], got[LAST_CV_NUM];
+	unsigned cuts[3] = { 0 };	/* header, snapshot, record */
+	size_t n = 0;
+	bool ok = true;
+
+	if (!img || !rec) {
+		perror("malloc");
+		exit(1);
+	}
+
+	reset_cvs();
+	memset(&cv_stats, 0, sizeof(cv_stats));
+	memcpy(img[n++], (const void *) DATA_EEPROM_BASE,
+	       DATA_EEPROM_BANK_SIZE);
+
+	for (unsigned b = 0; b < JOURNAL_BURSTS; b++) {
+		unsigned writes = 1 + rng() % JOURNAL_BURST_MAX;
+
+		for (unsigned w = 0; w < writes; w++)
+			write_cv(JOURNAL_CV_FIRST + rng() % JOURNAL_CV_COUNT,
+				 rng());
+		hal_stub_tick += CV_COMMIT_HOLDOFF_MS;
+
+		while (!cv_commit_idle()) {
+			uint16_t programs = cv_stats.programs;
+
+			cv_commit_poll();
+			if (cv_stats.programs == programs)
+				continue;
+			if (n == JOURNAL_PROGRAMS_MAX) {
+				fprintf(stderr, "journal: too many programs\n");
+				exit(1);
+			}
+			memcpy(img[n++], (const void *) DATA_EEPROM_BASE,
+			       DATA_EEPROM_BANK_SIZE);
+		}
+	}
+
+	for (uint16_t num = 1; num <= LAST_CV_NUM; num++)
+		want[num - 1] = read_cv(num);
+
+	for (size_t i = 0; i < n; i++)
+		journal_recover(img[i], rec[i]);
+
+	printf("\njournaled CV store (%u bursts to the speed table)\n",
+	       JOURNAL_BURSTS);
+	printf("programs         : %u, %u compactions\n", cv_stats.programs,
+	       cv_stats.compactions);
+
+	if (memcmp(rec[n - 1], want, LAST_CV_NUM) != 0) {
+		printf("reload           : WRONG\n");
+		ok = false;
+	}
+
+	/* A cut while programming a word, i, from img[i - 1] to img[i] */
+	for (size_t i = 1; i < n && ok; i++) {
+		uint32_t torn[JOURNAL_WORDS];
+		size_t w;
+
+		for (w = 0; w < JOURNAL_WORDS; w++) {
+			if (img[i][w] != img[i - 1][w])
+				break;
+		}
+		if (w == JOURNAL_WORDS)
+			continue;
+
+		uint32_t old = img[i - 1][w], new = img[i][w];
+		size_t at = w % JOURNAL_PAGE_WORDS;
+		unsigned kind = at == 0 ? 0 : at <= CV_SNAPSHOT_WORDS ? 1 : 2;
+		const uint32_t partial[] = {
+			0,
+			old & 0xffff0000u, old & 0x0000ffffu,
+			new & 0xffff0000u, new & 0x0000ffffu,
+		};
+
+		for (unsigned k = 0; k < 5; k++) {
+			memcpy(torn, img[i - 1], sizeof(torn));
+			torn[w] = partial[k];
+			journal_recover(torn, got);
+
+			if (memcmp(got, rec[i - 1], LAST_CV_NUM) != 0 &&
+			    memcmp(got, rec[i], LAST_CV_NUM) != 0) {
+				printf("recovered        : WRONG, cut in "
+				       "program %zu (word %zu)\n", i, w);
+				ok = false;
+				break;
+			}
+			cuts[kind]++;
+		}
+	}
+
+	printf("power cuts       : %u in a record, %u in a snapshot, "
+	       "%u in a header\n", cuts[2], cuts[1], cuts[0]);
+	if (ok)
+		printf("recovered        : ok, before or after the program\n");
+
+	free(rec);
+	free(img);
+
+	return ok;
+}
+
+/**
+ * Service mode writes to the speed table, each one cut off right after its
+ * ACK is scheduled: the written CV must come back from the data EEPROM. The
+ * ACK itself is then run as TIM21 would, and the power given back.
+ */
+#define SERVICE_WRITES		40
+
+static void service_send(const uint8_t *bytes, uint8_t len, uint16_t *end)
+{
+	struct dcc_packet p = { .len = len };
+
+	memcpy(p.bytes, bytes, len);
+	*end += 8000;	/* about one packet */
+	p.end = *end;
+	svc_packet(&p);
+}
+
+static bool bench_service(void)
+{
+	static const uint8_t reset[3] = { 0 };
+	uint32_t img[JOURNAL_WORDS];
+	uint8_t got[LAST_CV_NUM];
+	unsigned acked = 0;
+	uint16_t end = 0;
+	bool ok = true;
+
+	for (unsigned i = 0; i < SERVICE_WRITES && ok; i++) {
+		uint16_t num = JOURNAL_CV_FIRST + rng() % JOURNAL_CV_COUNT;
+		uint8_t val = rng();
+		uint8_t w[4] = { 0x7c | (num - 1) >> 8, (num - 1) & 0xff, val };
+
+		if (read_cv(num) == val)
+			continue;
+		w[3] = w[0] ^ w[1] ^ w[2];
+
+		for (unsigned r = 0; r < 3; r++)
+			service_send(reset, sizeof(reset), &end);
+		service_send(w, sizeof(w), &end);
+		service_send(w, sizeof(w), &end);
+
+		if (!(TIM21->DIER & TIM_DIER_CC2IE)) {
+			printf("service mode     : no ACK for CV#%u\n", num);
+			ok = false;
+			break;
+		}
+		acked++;
+
+		memcpy(img, (const void *) DATA_EEPROM_BASE, sizeof(img));
+		journal_recover(img, got);
+		if (got[num - 1] != val) {
+			printf("service mode     : CV#%u lost after its ACK\n",
+			       num);
+			ok = false;
+		}
+
+		svc_timer();
+		svc_timer();
+	}
+
+	if (ok)
+		printf("service mode     : %u writes cut after the ACK, "
+		       "all kept\n", acked);
+
+	return ok;
+}
+
+/**
+ * Function outputs, speed table and repeat cache, with packets given to
+ * decode() as decoder_poll() would. Under random CV#33 -> CV#46 and CV#29,
+ * every packet, sent twice as a command station repeats it, must leave the
+ * ports as the functions on map to, worked out here from the CVs. Every
+ * write to the speed table or its curve must give the table a full rebuild
+ * gives. A fixed sequence then checks which repeats the cache drops.
+ */
+#define OUTPUT_MAPPINGS		64
+#define OUTPUT_PACKETS		32
+#define SPEED_WRITES		4
+
+/* What the functions should be, from the packets sent */
+static struct {
+	uint8_t g1;		/* FL F4 F3 F2 F1 */
+	uint8_t f5_8;
+	uint8_t f9_12;
+	bool reverse;
+} want_fn;
+
+static void output_send(const uint8_t *payload, uint8_t n)
+{
+	uint8_t p[4] = { read_cv(1) };
+
+	for (uint8_t i = 0; i < n; i++)
+		p[i + 1] = payload[i];
+	p[n + 1] = 0;
+	for (uint8_t i = 0; i <= n; i++)
+		p[n + 1] ^= p[i];
+
+	decode(p, n + 2, 1);
+}
+
+/**
+ * Pins of function fn (FL(f), FL(r), F1 -> F12): its CV holds outputs 1 -> 8,
+ * 4 -> 11 from F4 on, 7 -> 14 from F7 on.
+ */
+static uint32_t output_pins(uint8_t fn)
+{
+	uint8_t shift = (fn < 5) ? 0 : (fn < 10) ? 3 : 6;
+	uint16_t outs = read_cv(33 + fn) << shift;
+	uint32_t pins = 0;
+
+	for (uint8_t out = 0; out < LIGHT_OUTPUTS; out++)
+		if (outs & (1u << out))
+			pins |= light_output_word(out);
+
+	return pins;
+}
+
+static bool outputs_match(void)
+{
+	bool swap = read_cv(29) & 0x01u;
+	uint32_t all = 0, on = 0;
+
+	for (uint8_t out = 0; out < LIGHT_OUTPUTS; out++)
+		all |= light_output_word(out);
+
+	for (uint8_t n = 0; n < 4; n++) {
+		if (want_fn.g1 & (1u << n))
+			on |= output_pins(2 + n);
+		if (want_fn.f5_8 & (1u << n))
+			on |= output_pins(6 + n);
+		if (want_fn.f9_12 & (1u << n))
+			on |= output_pins(10 + n);
+	}
+	if (want_fn.g1 & 0x10u)
+		on |= output_pins((want_fn.reverse != swap) ? 1 : 0);
+	on &= all;
+
+	/* As light_outputs() writes them, every output being steady */
+	return GPIOA->BSRR == ((all << 16) | (on & 0xffffu)) &&
+	       GPIOB->BSRR == ((all & 0xffff0000u) | (on >> 16));
+}
+
+/* A random function or speed packet, followed in want_fn */
+static uint8_t output_packet(uint8_t *payload)
+{
+	bool fl_in_g1 = read_cv(29) & 0x02u;
+	uint8_t instr;
+
+	switch (rng() % 4) {
+	case 0:		/* 100DDDDD */
+		instr = 0x80u | (rng() & 0x1fu);
+		want_fn.g1 = (want_fn.g1 & (fl_in_g1 ? 0 : 0x10u)) |
+			     (instr & (fl_in_g1 ? 0x1fu : 0x0fu));
+		break;
+	case 1:		/* 101SDDDD */
+		instr = 0xa0u | (rng() & 0x1fu);
+		if (instr & 0x10u)
+			want_fn.f5_8 = instr & 0x0fu;
+		else
+			want_fn.f9_12 = instr & 0x0fu;
+		break;
+	case 2:		/* 01DCSSSS */
+		instr = 0x40u | (rng() & 0x3fu);
+		want_fn.reverse = !(instr & 0x20u);
+		if (!fl_in_g1)
+			want_fn.g1 = (want_fn.g1 & 0x0fu) | (instr & 0x10u);
+		break;
+	default:	/* 128 speed steps */
+		payload[0] = 0x3f;
+		payload[1] = rng();
+		want_fn.reverse = !(payload[1] & 0x80u);
+		return 2;
+	}
+
+	payload[0] = instr;
+	return 1;
+}
+
+/* The table built by the writes so far against a full rebuild */
+static bool speed_table_match(void)
+{
+	uint8_t lut[SPEED_LUT_LEN];
+	uint8_t kick = speed_kick;
+
+	memcpy(lut, speed_lut, sizeof(lut));
+	speed_table_update(0);
+
+	return memcmp(lut, speed_lut, sizeof(lut)) == 0 && kick == speed_kick;
+}
+
+static bool bench_outputs(void)
+{
+	static const uint8_t curve_cvs[] = { 2, 5, 6, 65 };
+	/* Payload, length, whether it must be executed */
+	static const struct {
+		uint8_t payload[2];
+		uint8_t n;
+		bool run;
+	} repeats[] = {
+		{ { 0x90 }, 1, true },		/* FL on */
+		{ { 0x90 }, 1, false },
+		{ { 0x91 }, 1, true },		/* F1 on too */
+		{ { 0x68 }, 1, true },		/* 14/28 steps, forward */
+		{ { 0x68 }, 1, false },
+		{ { 0x3f, 0x90 }, 2, true },	/* 128 steps, same slot */
+		{ { 0x68 }, 1, true },		/* replaced it, runs again */
+		{ { 0x60 }, 1, true },		/* stop: flushes */
+		{ { 0x68 }, 1, true },
+		{ { 0x91 }, 1, true },
+		{ { 0x91 }, 1, false },
+		{ { 0x48 }, 1, true },		/* reverse: flushes */
+		{ { 0x91 }, 1, true },
+		{ { 0x91 }, 1, false },
+	};
+	static const uint8_t sync[][2] = {
+		{ 0x80 }, { 0xa0 }, { 0xb0 }, { 0x3f, 0x80 }
+	};
+	unsigned packets = 0, writes = 0;
+	bool ok = true;
+
+	printf("\nfunction outputs, speed table and repeat cache\n");
+	reset_cvs();
+
+	/* FL from Function Group One, all functions off, forward */
+	write_cv(29, read_cv(29) | 0x02u);
+	for (unsigned i = 0; i < 4; i++)
+		output_send(sync[i], (i < 3) ? 1 : 2);
+	memset(&want_fn, 0, sizeof(want_fn));
+
+	for (unsigned m = 0; m < OUTPUT_MAPPINGS && ok; m++) {
+		/* Swapped lights, FL in FG1, speed table or curve */
+		write_cv(29, (read_cv(29) & ~0x13u) | (rng() & 0x13u));
+		for (uint16_t num = 33; num <= 46; num++)
+			write_cv(num, rng());
+		ok = speed_table_match();
+
+		for (unsigned w = 0; w < SPEED_WRITES && ok; w++) {
+			uint8_t r = rng() % 32;
+			uint16_t num = (r < 28) ? 67 + r : curve_cvs[r - 28];
+
+			/* Vhigh and Vmid are unset at 0 and 1 */
+			write_cv(num, (rng() & 7) ? rng() : rng() & 1);
+			writes++;
+			if (!speed_table_match()) {
+				printf("speed table      : WRONG after CV#%u\n",
+				       num);
+				ok = false;
+			}
+		}
+
+		for (unsigned p = 0; p < OUTPUT_PACKETS && ok; p++) {
+			uint8_t payload[2];
+			uint8_t n = output_packet(payload);
+
+			for (unsigned r = 0; r < 2 && ok; r++) {
+				output_send(payload, n);
+				packets++;
+				if (!outputs_match()) {
+					printf("function outputs : WRONG after "
+					       "%02x (CV#29 %02x)\n", payload[0],
+					       read_cv(29));
+					ok = false;
+				}
+			}
+		}
+	}
+
+	dcc_cache_flush();
+	for (unsigned i = 0; i < sizeof(repeats) / sizeof(*repeats) && ok;
+	     i++) {
+		uint16_t hits = dcc_cache_stats.hits;
+
+		output_send(repeats[i].payload, repeats[i].n);
+		if ((dcc_cache_stats.hits == hits) != repeats[i].run) {
+			printf("repeat cache     : WRONG at step %u\n", i);
+			ok = false;
+		}
+	}
+
+	/* A CV write may change what the same packet does */
+	if (ok) {
+		uint16_t hits = dcc_cache_stats.hits;
+
+		write_cv(3, read_cv(3) ^ 0x01u);
+		output_send(repeats[0].payload, repeats[0].n);
+		if (dcc_cache_stats.hits != hits) {
+			printf("repeat cache     : WRONG after a CV write\n");
+			ok = false;
+		}
+	}
+
+	if (ok) {
+		printf("function outputs : %u packets, as CV#33 -> CV#46\n",
+		       packets);
+		printf("speed table      : %u writes, as a full rebuild\n",
+		       writes);
+		printf("repeat cache     : ok, repeats only run when they "
+		       "may act\n");
+	}
+
+	return ok;
+}
+
+int main(int argc, char **argv)
+{
+	struct trace tr = { 0 };
+	struct path_stats stats[PATH_COUNT] = { 0 };
+	size_t n = 100000;
+	unsigned jitter = 0, foreign = 80, preamble = 14, repeats = 3;
+	const char *in = NULL, *out = NULL;
+	bool ok;
+	int opt;
+
+	rng_state = 0x2545f491;
+
+	while ((opt = getopt(argc, argv, "n:j:f:p:s:R:r:w:")) != -1) {
+		switch (opt) {
+		case 'n':
+			n = strtoul(optarg, NULL, 0);
+			break;
+		case 'j':
+			jitter = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			foreign = strtoul(optarg, NULL, 0);
+			if (foreign > 100)
+				foreign = 100;
+			break;
+		case 'p':
+			preamble = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			rng_state = strtoul(optarg, NULL, 0) | 1;
+			break;
+		case 'R':
+			repeats = strtoul(optarg, NULL, 0);
+			if (repeats == 0)
+				repeats = 1;
+			break;
+		case 'r':
+			in = optarg;
+			break;
+		case 'w':
+			out = optarg;
+			break;
+		default:
+			fprintf(stderr,
+				"usage: %s [-n packets] [-j jitter_us] "
+				"[-f foreign_percent] [-p preamble_bits] "
+				"[-s seed] [-R repeats] [-r trace_file] "
+				"[-w trace_file]\n",
+				argv[0]);
+			return 1;
+		}
+	}
+
+	hal_stub_init();
+	reload_all_cvs();
+
+	if (in)
+		read_trace(&tr, in);
+	else
+		synth_trace(&tr, n, jitter, foreign, preamble);
+
+	if (out)
+		write_trace(&tr, out);
+
+	if (tr.len == 0) {
+		fprintf(stderr, "empty trace\n");
+		return 1;
+	}
+
+	/* Pass 1: plain replay, for throughput. HAL_GetTick() follows the signal */
+	reset_receiver();
+	uint32_t tick_us = 0;
+	uint64_t t0 = now_ns();
+	for (size_t i = 0; i < tr.len; i++) {
+		for (tick_us += tr.T[i]; tick_us >= 1000; tick_us -= 1000)
+			hal_stub_tick++;
+		interrupt_funct(tr.T[i]);
+		decoder_poll();
+		cv_commit_poll();
+	}
+	uint64_t elapsed = now_ns() - t0;
+	struct hal_stub_stats hal = hal_stub_stats;
+	struct fn_stats fn = fn_stats;
+	struct light_stats lights = light_stats;
+
+	/* Pass 2: per-edge timing, for the cost of each path */
+	uint64_t overhead = timer_overhead_ns();
+	uint8_t *path = malloc(tr.len);
+	uint32_t *cost = malloc(tr.len * sizeof(*cost));
+	uint32_t *dispatch = calloc(tr.len, sizeof(*dispatch));
+	uint16_t overflows = pq1.overflows;
+	uint8_t max_depth = pq1.max_depth;
+	struct rx_stats rx = rx_stats;
+	struct dcc_cache_stats cache = dcc_cache_stats;
+
+	if (!path || !cost || !dispatch) {
+		perror("malloc");
+		return 1;
+	}
+
+	for (unsigned r = 0; r < repeats; r++) {
+		reset_receiver();
+		for (size_t i = 0; i < tr.len; i++) {
+			enum bench_path p = classify(tr.T[i]);
+			uint64_t s = now_ns();
+
+			interrupt_funct(tr.T[i]);
+
+			uint64_t d = now_ns() - s;
+			d = sub_overhead(d, overhead);
+
+			if (r == 0 || d < cost[i])
+				cost[i] = d;
+			path[i] = p;
+
+			if (pq_peek(&pq1) == NULL)
+				continue;
+
+			s = now_ns();
+			decoder_poll();
+			d = now_ns() - s;
+			d = sub_overhead(d, overhead);
+
+			if (r == 0 || d < dispatch[i])
+				dispatch[i] = d;
+		}
+	}
+
+	for (size_t i = 0; i < tr.len; i++) {
+		struct path_stats *ps = &stats[path[i]];
+
+		ps->count++;
+		ps->total_ns += cost[i];
+		if (cost[i] > ps->max_ns)
+			ps->max_ns = cost[i];
+
+		if (path[i] != PATH_ONE_END)
+			continue;
+
+		ps = &stats[PATH_DISPATCH];
+		ps->count++;
+		ps->total_ns += dispatch[i];
+		if (dispatch[i] > ps->max_ns)
+			ps->max_ns = dispatch[i];
+	}
+
+	uint64_t completed = stats[PATH_ONE_END].count;
+	enum bench_path worst = PATH_ONE_FIRST;
+	enum bench_path worst_isr = PATH_ONE_FIRST;
+
+	printf("edges            : %zu\n", tr.len);
+	if (!in)
+		printf("packets sent     : %zu\n", tr.packets);
+	printf("packets received : %llu\n", (unsigned long long) completed);
+	printf("dropped by addr  : %u foreign, %u idle\n", rx.foreign,
+	       rx.idle);
+	printf("receiver errors  : %u checksum, %u preamble, %u symmetry, "
+	       "%u framing\n", rx.checksum, rx.preamble, rx.symmetry,
+	       rx.framing);
+	printf("replay time      : %.3f ms\n", elapsed / 1e6);
+	printf("packets/s        : %.0f\n", completed * 1e9 / elapsed);
+	printf("ns/edge          : %.2f\n", (double) elapsed / tr.len);
+	printf("timer overhead   : %llu ns (subtracted)\n\n",
+	       (unsigned long long) overhead);
+
+	printf("%-28s %10s %10s %10s\n", "path", "count", "avg ns", "max ns");
+	for (int p = 0; p < PATH_COUNT; p++) {
+		if (stats[p].count == 0)
+			continue;
+		printf("%-28s %10llu %10.1f %10llu\n", path_names[p],
+		       (unsigned long long) stats[p].count,
+		       (double) stats[p].total_ns / stats[p].count,
+		       (unsigned long long) stats[p].max_ns);
+		if (stats[p].max_ns > stats[worst].max_ns)
+			worst = p;
+		if (p != PATH_DISPATCH &&
+		    stats[p].max_ns > stats[worst_isr].max_ns)
+			worst_isr = p;
+	}
+
+	printf("\nworst-case path  : %s (%llu ns)\n", path_names[worst],
+	       (unsigned long long) stats[worst].max_ns);
+	printf("worst-case edge  : %s (%llu ns)\n", path_names[worst_isr],
+	       (unsigned long long) stats[worst_isr].max_ns);
+	printf("queue overflows  : %u (max depth %u)\n", overflows, max_depth);
+	printf("repeat cache     : %u hits, %u misses, %u bypassed\n",
+	       cache.hits, cache.misses, cache.bypassed);
+	printf("output writes    : %u to the ports, %u function updates\n",
+	       lights.port_writes, fn.updates);
+	printf("EEPROM programs  : %u (+%u by the commit engine)\n",
+	       hal.eeprom_programs, cv_stats.programs);
+
+	bench_legacy(&tr, repeats, overhead);
+	bench_capture(&tr, repeats, overhead);
+	ok = bench_journal();
+	ok = bench_service() && ok;
+	ok = bench_outputs() && ok;
+
+	free(dispatch);
+	free(cost);
+	free(path);
+	free(legacy_log.buf);
+	free(tr.T);
+
+	return ok ? 0 : 1;
+}
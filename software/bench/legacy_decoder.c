@@ -0,0 +1,169 @@
+/*******************************************************************************
+ * @file    :   legacy_decoder.c
+ * @brief   :   If/else cascade receiver replaced by the table-driven one, kept
+ *              as the reference of the host benchmark
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "legacy_decoder.h"
+
+#include <stdlib.h>
+
+static const uint32_t ONE_MIN = 52;
+static const uint32_t ONE_MAX = 64;
+static const uint32_t ONE_DELTA = 6;
+
+static const uint32_t ZERO_MIN = 90;
+static const uint32_t ZERO_MAX = 10000;
+static const uint32_t ZERO_COMPL = 12000;
+
+struct legacy_decoder {
+	uint8_t bytes[16];
+	uint8_t N, byte_n;
+	uint8_t actual_byte;
+	uint16_t T_prev;
+	bool half0, half1, has_preamble;
+};
+
+static struct legacy_decoder ldec;
+
+static legacy_packet_cb packet_cb;
+
+static void legacy_reset(struct legacy_decoder *dec)
+{
+	dec->half1 = false;
+	dec->half0 = false;
+	dec->has_preamble = false;
+	dec->T_prev = 0;
+	dec->N = 0;
+	dec->byte_n = 0;
+	dec->actual_byte = 0;
+}
+
+static void legacy_end(struct legacy_decoder *dec)
+{
+	if (packet_cb)
+		packet_cb(dec->bytes, dec->byte_n);
+
+	legacy_reset(dec);
+}
+
+void legacy_init(legacy_packet_cb cb)
+{
+	packet_cb = cb;
+	legacy_reset(&ldec);
+}
+
+void legacy_interrupt_funct(uint16_t T)
+{
+	if (ONE_MIN < T && T < ONE_MAX) { /* pulse duration is within ONE timings */
+		if (ldec.half1 == true)	{
+			/* it's second part of a 1-bit */
+
+			if (abs(T - ldec.T_prev) <= ONE_DELTA) {
+				/* difference between first and second part is within limits */
+
+				if (ldec.has_preamble == true) {
+					/* already have a preamble, it's a bit */
+
+					if (ldec.N == 8) {
+						/* end of packet bit */
+						ldec.bytes[ldec.byte_n] = ldec.actual_byte;
+						ldec.byte_n++;
+
+						legacy_end(&ldec);
+						return;
+					} else {
+						/* normal data bit */
+						uint8_t mask = 1 << (7 - ldec.N);
+
+						ldec.actual_byte |= mask;
+						ldec.N++;
+						ldec.half1 = false;
+						return;
+					}
+				} else {
+					/* has no preamble yet, it's a preamble bit */
+					ldec.N++;
+					ldec.half1 = false;
+					return;
+				}
+			} else {
+				/* difference between two parts outside limits */
+				legacy_reset(&ldec);
+				return;
+			}
+		}
+		else	/* first part of the bit */
+		{
+			ldec.half1 = true;
+			ldec.half0 = false;
+			ldec.T_prev = T;
+			return;
+		}
+	} else if (ZERO_MIN < T && T < ZERO_MAX) {
+		/* pulse duration is within ZERO timings */
+
+		if (ldec.half0 == true) {
+			/* it's second part of a 0-bit */
+
+			if (T + ldec.T_prev > ZERO_COMPL) {
+				/* Total bit length outside limits*/
+				legacy_reset(&ldec);
+				return;
+			} else {
+				if (ldec.has_preamble) {
+					/* already have a preamble, it's a bit */
+
+					if (ldec.N == 8) {
+						/* bit that marks the end of the byte */
+						if (ldec.byte_n >= sizeof(ldec.bytes) - 1) {
+							/* The original overflowed bytes[] */
+							legacy_reset(&ldec);
+							return;
+						}
+						ldec.bytes[ldec.byte_n] = ldec.actual_byte;
+						ldec.byte_n++;
+						ldec.N = 0;
+
+						ldec.half0 = false;
+						ldec.actual_byte = 0;
+						return;
+					} else	{
+						/* normal data bit */
+						ldec.N++;
+						ldec.half0 = false;
+						return;
+					}
+				} else {
+					/* No preamble yet, it's the end of a potential preamble */
+
+					if (ldec.N >= 10) {
+						/* Valid preamble */
+						ldec.has_preamble = true;
+						ldec.half0 = false;
+						ldec.N = 0;
+						return;
+					} else {
+						/* Invalid preamble */
+						legacy_reset(&ldec);
+						return;
+					}
+				}
+			}
+		} else {
+			/* first part of the bit */
+			ldec.half0 = true;
+			ldec.half1 = false;
+			ldec.T_prev = T;
+			return;
+		}
+	} else {
+		/* pulse duration marks neither a zero or a one */
+		legacy_reset(&ldec);
+	}
+
+	return;
+}
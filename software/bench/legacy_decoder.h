@@ -0,0 +1,25 @@
+/*******************************************************************************
+ * @file    :   legacy_decoder.h
+ * @brief   :   If/else cascade receiver replaced by the table-driven one, kept
+ *              as the reference of the host benchmark
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __BENCH_LEGACY_DECODER_H
+#define __BENCH_LEGACY_DECODER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef void (*legacy_packet_cb)(const uint8_t *bytes, uint8_t len);
+
+/**
+ * @brief Resets the receiver; cb is called for every completed packet.
+ */
+void legacy_init(legacy_packet_cb cb);
+
+void legacy_interrupt_funct(uint16_t T);
+
+#endif /* __BENCH_LEGACY_DECODER_H */
@@ -0,0 +1,124 @@
+/*******************************************************************************
+ * @file    :   hal_stub.c
+ * @brief   :   Host implementation of the stubbed STM32L0 HAL functions
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "stm32l0xx_hal.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+GPIO_TypeDef bench_gpioa, bench_gpiob;
+FLASH_TypeDef bench_flash;
+SCB_Type bench_scb;
+SysTick_Type bench_systick;
+RCC_TypeDef bench_rcc;
+TIM_TypeDef bench_tim2, bench_tim21, bench_tim22;
+ADC_HandleTypeDef hadc;
+DMA_HandleTypeDef hdma_adc;
+uint32_t SystemCoreClock = 32000000;
+
+struct hal_stub_stats hal_stub_stats;
+uint32_t hal_stub_tick;
+
+void hal_stub_init(void)
+{
+	void *p = mmap((void *) DATA_EEPROM_BASE, DATA_EEPROM_BANK_SIZE,
+		       PROT_READ | PROT_WRITE,
+		       MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE, -1, 0);
+
+	if (p != (void *) DATA_EEPROM_BASE) {
+		fprintf(stderr, "hal_stub: cannot map data EEPROM at 0x%08lx\n",
+			DATA_EEPROM_BASE);
+		exit(1);
+	}
+
+	memset(&bench_gpioa, 0, sizeof(bench_gpioa));
+	memset(&bench_gpiob, 0, sizeof(bench_gpiob));
+	memset(&bench_flash, 0, sizeof(bench_flash));
+	memset(&bench_scb, 0, sizeof(bench_scb));
+	memset(&bench_systick, 0, sizeof(bench_systick));
+	memset(&bench_rcc, 0, sizeof(bench_rcc));
+	memset(&bench_tim2, 0, sizeof(bench_tim2));
+	memset(&bench_tim21, 0, sizeof(bench_tim21));
+	memset(&bench_tim22, 0, sizeof(bench_tim22));
+	memset(&hal_stub_stats, 0, sizeof(hal_stub_stats));
+	hal_stub_tick = 0;
+}
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin,
+		       GPIO_PinState PinState)
+{
+	if (PinState != GPIO_PIN_RESET)
+		GPIOx->ODR |= GPIO_Pin;
+	else
+		GPIOx->ODR &= ~(uint32_t) GPIO_Pin;
+
+	hal_stub_stats.gpio_writes++;
+}
+
+uint32_t HAL_GetTick(void)
+{
+	return hal_stub_tick;
+}
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData,
+				    uint32_t Length)
+{
+	(void) hadc;
+	(void) pData;
+	(void) Length;
+	hal_stub_stats.adc_starts++;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc)
+{
+	(void) hadc;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Unlock(void)
+{
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Lock(void)
+{
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Erase(uint32_t Address)
+{
+	*(__IO uint32_t *) (uintptr_t) Address = 0;
+	hal_stub_stats.eeprom_erases++;
+
+	return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Program(uint32_t TypeProgram,
+						 uint32_t Address,
+						 uint32_t Data)
+{
+	switch (TypeProgram) {
+	case FLASH_TYPEPROGRAMDATA_BYTE:
+		*(__IO uint8_t *) (uintptr_t) Address = (uint8_t) Data;
+		break;
+	case FLASH_TYPEPROGRAMDATA_HALFWORD:
+		*(__IO uint16_t *) (uintptr_t) Address = (uint16_t) Data;
+		break;
+	default:
+		*(__IO uint32_t *) (uintptr_t) Address = Data;
+		break;
+	}
+	hal_stub_stats.eeprom_programs++;
+
+	return HAL_OK;
+}
@@ -0,0 +1,268 @@
+/*******************************************************************************
+ * @file    :   stm32l0xx_hal.h
+ * @brief   :   Host stub of the subset of the STM32L0 HAL used by the DCC
+ *              layer, so that the decoder can be built and run on a PC
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __BENCH_STM32L0XX_HAL_H
+#define __BENCH_STM32L0XX_HAL_H
+
+#include <stdint.h>
+
+#define __IO	volatile
+
+typedef enum {
+	HAL_OK = 0x00U,
+	HAL_ERROR = 0x01U,
+	HAL_BUSY = 0x02U,
+	HAL_TIMEOUT = 0x03U
+} HAL_StatusTypeDef;
+
+/* CMSIS -------------------------------------------------------------------*/
+
+#define __DMB()		__sync_synchronize()
+#define __disable_irq()	do { } while (0)
+#define __enable_irq()	do { } while (0)
+
+typedef struct {
+	__IO uint32_t CPUID;
+	__IO uint32_t ICSR;
+	__IO uint32_t VTOR;
+	__IO uint32_t AIRCR;
+	__IO uint32_t SCR;
+	__IO uint32_t CCR;
+	uint32_t RESERVED1;
+	__IO uint32_t SHP[2];
+	__IO uint32_t SHCSR;
+} SCB_Type;
+
+extern SCB_Type bench_scb;
+
+#define SCB	(&bench_scb)
+
+#define SCB_ICSR_PENDSVSET_Msk	(1UL << 28)
+
+typedef struct {
+	__IO uint32_t CTRL;
+	__IO uint32_t LOAD;
+	__IO uint32_t VAL;
+	__IO uint32_t CALIB;
+} SysTick_Type;
+
+extern SysTick_Type bench_systick;
+
+#define SysTick	(&bench_systick)
+
+extern uint32_t SystemCoreClock;
+
+/**
+ * Milliseconds of replayed signal: hal_stub_tick is advanced by the bench,
+ * reading it costs no system call.
+ */
+extern uint32_t hal_stub_tick;
+
+uint32_t HAL_GetTick(void);
+
+/* RCC / PWR -----------------------------------------------------------------*/
+
+typedef struct {
+	__IO uint32_t CR;
+	__IO uint32_t ICSCR;
+} RCC_TypeDef;
+
+extern RCC_TypeDef bench_rcc;
+
+#define RCC	(&bench_rcc)
+
+#define RCC_ICSCR_HSITRIM_Pos		8U
+#define RCC_ICSCR_HSITRIM		(0x1FUL << RCC_ICSCR_HSITRIM_Pos)
+
+#define RCC_HSICALIBRATION_DEFAULT	0x10U
+
+#define __HAL_RCC_HSI_CALIBRATIONVALUE_ADJUST(__HSICALIBRATIONVALUE__) \
+	(RCC->ICSCR = (RCC->ICSCR & ~RCC_ICSCR_HSITRIM) | \
+		      ((uint32_t) (__HSICALIBRATIONVALUE__) << \
+		       RCC_ICSCR_HSITRIM_Pos))
+
+/* Operating point parameters, only carried by clock.c */
+#define RCC_HSI_ON			0x01U
+#define RCC_PLL_OFF			0x01U
+#define RCC_PLL_ON			0x02U
+#define RCC_SYSCLKSOURCE_HSI		0x01U
+#define RCC_SYSCLKSOURCE_PLLCLK		0x03U
+#define PWR_REGULATOR_VOLTAGE_SCALE1	0x0800U
+#define PWR_REGULATOR_VOLTAGE_SCALE2	0x1000U
+#define FLASH_LATENCY_1			0x01U
+
+/* TIM -----------------------------------------------------------------------*/
+
+typedef struct {
+	__IO uint32_t CR1;
+	__IO uint32_t CR2;
+	__IO uint32_t SMCR;
+	__IO uint32_t DIER;
+	__IO uint32_t SR;
+	__IO uint32_t EGR;
+	__IO uint32_t CCMR1;
+	__IO uint32_t CCMR2;
+	__IO uint32_t CCER;
+	__IO uint32_t CNT;
+	__IO uint32_t PSC;
+	__IO uint32_t ARR;
+	uint32_t RESERVED12;
+	__IO uint32_t CCR1;
+	__IO uint32_t CCR2;
+	__IO uint32_t CCR3;
+	__IO uint32_t CCR4;
+} TIM_TypeDef;
+
+extern TIM_TypeDef bench_tim2, bench_tim21, bench_tim22;
+
+#define TIM2	(&bench_tim2)
+#define TIM21	(&bench_tim21)
+#define TIM22	(&bench_tim22)
+
+#define TIM_DIER_CC1IE		(0x1UL << 1)
+#define TIM_DIER_CC2IE		(0x1UL << 2)
+#define TIM_SR_CC2IF		(0x1UL << 2)
+
+#define TIM_CCMR1_OC1M_0	(0x1UL << 4)
+#define TIM_CCMR1_OC1M_1	(0x2UL << 4)
+#define TIM_CCMR1_OC1M_2	(0x4UL << 4)
+#define TIM_CCMR1_OC1M		(0x7UL << 4)
+#define TIM_CCMR1_OC2M		(0x7UL << 12)
+
+/* GPIO ----------------------------------------------------------------------*/
+
+typedef struct {
+	__IO uint32_t MODER;
+	__IO uint32_t OTYPER;
+	__IO uint32_t OSPEEDR;
+	__IO uint32_t PUPDR;
+	__IO uint32_t IDR;
+	__IO uint32_t ODR;
+	__IO uint32_t BSRR;
+	__IO uint32_t LCKR;
+	__IO uint32_t AFR[2];
+	__IO uint32_t BRR;
+} GPIO_TypeDef;
+
+typedef enum {
+	GPIO_PIN_RESET = 0U,
+	GPIO_PIN_SET
+} GPIO_PinState;
+
+#define GPIO_PIN_0	((uint16_t)0x0001U)
+#define GPIO_PIN_1	((uint16_t)0x0002U)
+#define GPIO_PIN_2	((uint16_t)0x0004U)
+#define GPIO_PIN_3	((uint16_t)0x0008U)
+#define GPIO_PIN_4	((uint16_t)0x0010U)
+#define GPIO_PIN_5	((uint16_t)0x0020U)
+#define GPIO_PIN_6	((uint16_t)0x0040U)
+#define GPIO_PIN_7	((uint16_t)0x0080U)
+#define GPIO_PIN_8	((uint16_t)0x0100U)
+#define GPIO_PIN_9	((uint16_t)0x0200U)
+#define GPIO_PIN_10	((uint16_t)0x0400U)
+#define GPIO_PIN_11	((uint16_t)0x0800U)
+#define GPIO_PIN_12	((uint16_t)0x1000U)
+#define GPIO_PIN_13	((uint16_t)0x2000U)
+#define GPIO_PIN_14	((uint16_t)0x4000U)
+#define GPIO_PIN_15	((uint16_t)0x8000U)
+
+extern GPIO_TypeDef bench_gpioa, bench_gpiob;
+
+#define GPIOA	(&bench_gpioa)
+#define GPIOB	(&bench_gpiob)
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin,
+		       GPIO_PinState PinState);
+
+/* ADC / DMA -----------------------------------------------------------------*/
+
+typedef struct {
+	uint32_t State;
+} DMA_HandleTypeDef;
+
+typedef struct {
+	DMA_HandleTypeDef *DMA_Handle;
+	uint32_t State;
+} ADC_HandleTypeDef;
+
+HAL_StatusTypeDef HAL_ADC_Start_DMA(ADC_HandleTypeDef *hadc, uint32_t *pData,
+				    uint32_t Length);
+HAL_StatusTypeDef HAL_ADC_Stop_DMA(ADC_HandleTypeDef *hadc);
+
+/* FLASH / data EEPROM -------------------------------------------------------*/
+
+/**
+ * The data EEPROM is emulated by a host mapping at the same address it has on
+ * the STM32L031, so the absolute addresses used by cv.c stay valid.
+ */
+#define DATA_EEPROM_BASE	0x08080000UL
+#define DATA_EEPROM_BANK_SIZE	512U
+
+typedef struct {
+	__IO uint32_t ACR;
+	__IO uint32_t PECR;
+	__IO uint32_t PDKEYR;
+	__IO uint32_t PEKEYR;
+	__IO uint32_t PRGKEYR;
+	__IO uint32_t OPTKEYR;
+	__IO uint32_t SR;
+	__IO uint32_t OPTR;
+	__IO uint32_t WRPR;
+} FLASH_TypeDef;
+
+extern FLASH_TypeDef bench_flash;
+
+#define FLASH	(&bench_flash)
+
+#define FLASH_FLAG_BSY		(1U << 0)
+#define FLASH_FLAG_EOP		(1U << 1)
+#define FLASH_FLAG_ENDHV	(1U << 2)
+#define FLASH_FLAG_READY	(1U << 3)
+#define FLASH_FLAG_WRPERR	(1U << 8)
+#define FLASH_FLAG_PGAERR	(1U << 9)
+#define FLASH_FLAG_SIZERR	(1U << 10)
+#define FLASH_FLAG_OPTVERR	(1U << 11)
+#define FLASH_FLAG_RDERR	(1U << 13)
+#define FLASH_FLAG_NOTZEROERR	(1U << 16)
+#define FLASH_FLAG_FWWERR	(1U << 17)
+
+#define __HAL_FLASH_GET_FLAG(__FLAG__)	(((FLASH->SR) & (__FLAG__)) == (__FLAG__))
+#define __HAL_FLASH_CLEAR_FLAG(__FLAG__)	((FLASH->SR) = (__FLAG__))
+
+#define FLASH_TYPEPROGRAMDATA_BYTE	0x00U
+#define FLASH_TYPEPROGRAMDATA_HALFWORD	0x01U
+#define FLASH_TYPEPROGRAMDATA_WORD	0x02U
+
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Unlock(void);
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Lock(void);
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Erase(uint32_t Address);
+HAL_StatusTypeDef HAL_FLASHEx_DATAEEPROM_Program(uint32_t TypeProgram,
+						 uint32_t Address,
+						 uint32_t Data);
+
+/* Bench bookkeeping ---------------------------------------------------------*/
+
+/**
+ * @brief Counters of the HAL calls performed by the code under test.
+ */
+struct hal_stub_stats {
+	uint32_t gpio_writes;
+	uint32_t adc_starts;
+	uint32_t eeprom_erases;
+	uint32_t eeprom_programs;
+};
+
+extern struct hal_stub_stats hal_stub_stats;
+
+/**
+ * @brief Maps the emulated data EEPROM. Must be called before any CV access.
+ */
+void hal_stub_init(void);
+
+#endif /* __BENCH_STM32L0XX_HAL_H */
@@ -0,0 +1,30 @@
+/**
+  ******************************************************************************
+  * @file    adc.h
+  * @brief   This file contains all the function prototypes for
+  *          the adc.c file
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#ifndef __ADC_H
+#define __ADC_H
+
+#include "main.h"
+
+extern ADC_HandleTypeDef hadc;
+
+extern DMA_HandleTypeDef hdma_adc;
+
+void MX_ADC_Init(void);
+
+#endif /* __ADC_H */
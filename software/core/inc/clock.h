@@ -0,0 +1,129 @@
+/*******************************************************************************
+ * @file    :   clock.h
+ * @brief   :   Operating points, HSI16 trimming and receiver timing
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __CLOCK_H
+#define __CLOCK_H
+
+#include <stdint.h>
+
+#include "main.h"
+
+/**
+ * Operating points, both on HSI16 so that the trim below applies to each:
+ * name, SYSCLK, regulator range, flash wait states, HSI16 state, PLL state,
+ * SYSCLK source and TIM22 prescaler (about 20 kHz of motor PWM). TIM2 and
+ * TIM21 are always prescaled to 1 us, so the timing constants of the
+ * receiver, the motor tick and the ACK hold at either point.
+ *
+ * HSI16 saves the PLL and runs the core at range 2. The MSI ranges are
+ * multiples of 32.768 kHz, which no prescaler turns into 1 us, and would
+ * escape the trim: there is no lower point.
+ */
+#define CLOCK_OPS(X) \
+	X(PLL32, 32000000, PWR_REGULATOR_VOLTAGE_SCALE1, FLASH_LATENCY_1, \
+	  RCC_HSI_ON, RCC_PLL_ON, RCC_SYSCLKSOURCE_PLLCLK, 12) \
+	X(HSI16, 16000000, PWR_REGULATOR_VOLTAGE_SCALE2, FLASH_LATENCY_1, \
+	  RCC_HSI_ON, RCC_PLL_OFF, RCC_SYSCLKSOURCE_HSI, 6)
+
+#define CLOCK_OP_ID(name, ...)	CLOCK_##name,
+enum clock_op_id {
+	CLOCK_OPS(CLOCK_OP_ID)
+	CLOCK_OP_COUNT
+};
+#undef CLOCK_OP_ID
+
+/* Selected at build time, e.g. make CLOCK=HSI16 */
+#ifndef CLOCK_OP
+#define CLOCK_OP		CLOCK_PLL32
+#endif
+
+struct clock_op {
+	uint32_t hz;
+	uint32_t voltage_scale;
+	uint32_t flash_latency;
+	uint32_t hsi_state;
+	uint32_t pll_state;
+	uint32_t sysclk_source;
+	uint16_t pwm_prescaler;
+};
+
+extern const struct clock_op *const clock_op;
+
+/* HSITRIM steps the trim may move away from the factory calibration */
+#define CLOCK_TRIM_RANGE	6
+
+/* Roughly 0.5 % of HSI16 per HSITRIM step */
+#define CLOCK_TRIM_STEP_PPM	5000
+
+/* Motor ticks (7 ms) of samples behind each trim decision */
+#define CLOCK_TRIM_TICKS	128
+
+/**
+ * error_ppm is the clock error measured over the last decision, positive when
+ * the clock runs fast; offset is the trim applied, in HSITRIM steps from the
+ * factory value. The cycle counts are the worst seen by the receiver, on
+ * SysTick, to be read with a debugger: they have no ceiling to check.
+ */
+struct clock_stats {
+	uint16_t trims;
+	uint16_t skipped;	/* decisions without enough signal */
+	int32_t error_ppm;
+	int8_t offset;
+	uint16_t edge_cycles_max;	/* receiver only, per edge of a batch */
+	uint16_t packet_cycles_max;
+};
+
+extern struct clock_stats clock_stats;
+
+/**
+ * @returns: the HSICalibrationValue for SystemClock_Config(), which also
+ * runs on every wake up from Stop.
+ */
+uint32_t clock_hsi_trim(void);
+
+/**
+ * @brief Samples the period of a 1 and, every CLOCK_TRIM_TICKS, moves the
+ * HSI16 trim one step towards the nominal 116 us. Called from the main loop
+ * scheduler, once per motor tick.
+ */
+void clock_trim_poll(void);
+
+/**
+ * @returns: the core cycles since start, a SysTick value. SysTick counts
+ * down and reloads every millisecond.
+ */
+static inline uint32_t clock_cycles(uint32_t start)
+{
+	uint32_t cycles = start - SysTick->VAL;
+
+	if ((int32_t) cycles < 0)
+		cycles += SysTick->LOAD + 1;
+
+	return cycles;
+}
+
+/**
+ * @brief Records a batch of edges, timed from edge_drain().
+ */
+static inline void clock_edges(uint32_t cycles, uint8_t edges)
+{
+	/* Divides only on a new maximum */
+	if (cycles > (uint32_t) clock_stats.edge_cycles_max * edges)
+		clock_stats.edge_cycles_max = cycles / edges;
+}
+
+/**
+ * @brief Records the decoding of a packet.
+ */
+static inline void clock_packet(uint32_t cycles)
+{
+	if (cycles > clock_stats.packet_cycles_max)
+		clock_stats.packet_cycles_max = cycles;
+}
+
+#endif //__CLOCK_H
@@ -0,0 +1,73 @@
+/*******************************************************************************
+ * @file    :   bemf.h
+ * @brief   :   Back EMF measurement and load compensation of the motor
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_BEMF_H
+#define __DCC_BEMF_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Conversions per window, one per TIM22 period (48 µs) */
+#define BEMF_SAMPLES		8
+/* Leading conversions discarded while the motor current decays */
+#define BEMF_SETTLE		4
+
+/* Manufacturer CVs of the controller */
+#define CV_BEMF_KP		50	/* proportional gain, 0 with KI: open loop */
+#define CV_BEMF_KI		51	/* integral gain */
+#define CV_BEMF_FULL		52	/* back EMF at full speed, ADC counts / 16 */
+#define CV_BEMF_PERIOD		53	/* control period, in motor ticks */
+
+/**
+ * Controller state and cost. cycles is the cost of one update, share_ppm the
+ * CPU share it takes at the configured period, in parts per million.
+ */
+struct bemf_stats {
+	uint32_t windows;
+	uint16_t timeouts;	/* windows not completed by the next tick */
+	uint16_t value;		/* last back EMF, ADC counts */
+	int16_t correction;	/* duty added to speed_lut[] */
+	uint16_t cycles, cycles_max;
+	uint16_t share_ppm, share_ppm_max;
+};
+
+extern struct bemf_stats bemf_stats;
+
+/**
+ * @brief Reloads the cutout step (CV#10), the gains and the control period.
+ */
+void bemf_config(void);
+
+/**
+ * @returns: true while a window is open: the bridge is off and the motor
+ * output must not be touched.
+ */
+bool bemf_busy(void);
+
+/**
+ * @brief Aborts a window that did not complete in time.
+ */
+void bemf_cancel(void);
+
+/**
+ * @brief Called on every motor tick. Returns true when a control period has
+ * elapsed: the caller then turns the bridge off and calls bemf_start().
+ */
+bool bemf_due(uint8_t step);
+
+/**
+ * @brief Starts the conversions of a window, synchronised to TIM22.
+ */
+void bemf_start(void);
+
+/**
+ * @returns: the feed-forward duty of step, corrected by the controller.
+ */
+uint8_t bemf_adjust(uint8_t duty, uint8_t step);
+
+#endif //__DCC_BEMF_H
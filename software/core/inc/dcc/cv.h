@@ -17,15 +17,36 @@
 #define EEPROM_SIZE		512
 
 #define LAST_CV_NUM		128
-#define CV_BANK1_START_ADDR		(EEPROM_START_ADDR)
-#define CV_BANK1_END_ADDR		(CV_BANK1_START_ADDR + LAST_CV_NUM - 1)
-#define CV_BANK1_OK_ADDR		(CV_BANK1_END_ADDR + 1)
-#define CV_BANK2_START_ADDR		(CV_BANK1_OK_ADDR + 4)
-#define CV_BANK2_END_ADDR		(CV_BANK2_START_ADDR + LAST_CV_NUM - 1)
-#define CV_BANK2_OK_ADDR		(CV_BANK2_END_ADDR + 4)
+
+/* Journaled CV store, see cv.c for the layout */
+#define CV_PAGE_SIZE		(EEPROM_SIZE / 2)
+#define CV_PAGE_ADDR(p)		(EEPROM_START_ADDR + (p) * CV_PAGE_SIZE)
+#define CV_SNAPSHOT_WORDS	(LAST_CV_NUM / 4)
+#define CV_JOURNAL_SLOTS	(CV_PAGE_SIZE / 4 - 1 - CV_SNAPSHOT_WORDS)
+
+/* Quiet time after the last write before the commit starts */
+#define CV_COMMIT_HOLDOFF_MS	100
+
+/* Programs of a word that reads back wrong before it is given up */
+#define CV_PROGRAM_RETRIES	3
 
 enum cv_op_result {CV_OP_OK, CV_OP_ERROR} ;
 
+/**
+ * Counters of the background CV commit engine.
+ */
+struct cv_commit_stats {
+	uint16_t requests;	/* write_cv() calls */
+	uint16_t coalesced;	/* writes merged into a word not committed yet */
+	uint16_t skipped;	/* writes or words already up to date */
+	uint16_t programs;	/* EEPROM word programs issued */
+	uint16_t compactions;	/* journal full, snapshot moved to the other page */
+	uint16_t retries;	/* programs read back wrong and reissued */
+	uint16_t errors;	/* words given up after CV_PROGRAM_RETRIES */
+};
+
+extern struct cv_commit_stats cv_stats;
+
 /**
  * @brief: Checks if a CV's functionality is implemented.
  * @returns: true if the CV is implemented, false otherwise.
@@ -33,15 +54,17 @@ enum cv_op_result {CV_OP_OK, CV_OP_ERROR} ;
 bool is_cv_implemented(uint16_t num);
 
 /**
- * @brief: Copies the value of all CVs from the data EEPROM to the RAM array.
+ * @brief: Rebuilds the RAM array of all CVs from the data EEPROM, resetting
+ * them to factory defaults if no valid page is found.
  */
 uint8_t reload_all_cvs(void);
 
 /**
- * @brief: Saves all the CVs to the data EEPROM. Usually not needed since the
- * values are kept syncronized between RAM and EEPROM.
+ * @brief: Saves all the CVs to the data EEPROM as the snapshot of a fresh page,
+ * waiting for the NVM. Usually not needed since the values are kept
+ * syncronized between RAM and EEPROM.
  */
-uint8_t save_all_cvs(uint8_t bank);
+uint8_t save_all_cvs(void);
 
 /**
  * @brief Reads the value of a single CV.
@@ -49,11 +72,32 @@ uint8_t save_all_cvs(uint8_t bank);
 uint8_t read_cv(uint16_t num);
 
 /**
- * @brief Set the value of a single CV. The new value is updated both in RAM and
- * in persistent storage.
+ * @brief Set the value of a single CV. The new value is updated in RAM
+ * immediately and committed to persistent storage in the background by
+ * cv_commit_poll().
  */
 uint8_t write_cv(uint16_t num, uint8_t val);
 
+/**
+ * @brief Advances the commit of the written CVs to the data EEPROM by at most
+ * one word program. Never waits for the NVM; call it from the main loop.
+ */
+void cv_commit_poll(void);
+
+/**
+ * @returns: true if every written CV has reached the data EEPROM.
+ */
+bool cv_commit_idle(void);
+
+/**
+ * @brief Commits every written CV now, without the hold-off, and waits for
+ * the last program to read back. For writes that are acknowledged, which must
+ * survive the power being cut right after: one word program (a few ms) unless
+ * the journal is full and the snapshot moves.
+ * @returns: CV_OP_ERROR if a word had to be given up.
+ */
+uint8_t cv_commit_flush(void);
+
 /* void init_volatile_cvs(void); */
 
 /**
@@ -0,0 +1,109 @@
+/*******************************************************************************
+ * @file    :   cv_table.h
+ * @brief   :   Descriptors of the implemented Configuration Variables
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_CV_TABLE_H
+#define __DCC_CV_TABLE_H
+
+#include "config.h"
+
+/* Descriptor flags */
+#define CV_RO		0x01	/* read only, always holds its default */
+#define CV_RECOMPUTE	0x02	/* state derived from it must be rebuilt */
+
+#define CV_VERSION	1	/* CV#7, firmware version */
+#define CV_MANUFACTURER	13	/* CV#8, public domain and DIY decoders */
+
+/* Linear speed table, CV#67 -> CV#94 */
+#define CV_SPEED_DEFAULT(step)	(((step) + 1) * 255 / 28)
+
+/**
+ * The single list of implemented CVs, in ascending order:
+ * X(arg, number, default, min, max, flags). cv.c expands it into the bitmaps
+ * and the packed arrays looked up by read_cv() and write_cv().
+ */
+#define CV_TABLE(X, a) \
+	X(a, 1, DCC_ADDRESS, 1, 127, CV_RECOMPUTE)	/* Primary Address */ \
+	X(a, 2, 0, 0, 255, CV_RECOMPUTE)	/* Vstart */ \
+	X(a, 3, 0, 0, 255, CV_RECOMPUTE)	/* Acceleration Rate */ \
+	X(a, 4, 0, 0, 255, CV_RECOMPUTE)	/* Deceleration Rate */ \
+	X(a, 5, 0, 0, 255, CV_RECOMPUTE)	/* Vhigh, 0: full speed */ \
+	X(a, 6, 0, 0, 255, CV_RECOMPUTE)	/* Vmid, 0: halfway */ \
+	X(a, 7, CV_VERSION, 0, 255, CV_RO) \
+	X(a, 8, CV_MANUFACTURER, 0, 255, CV_RO) \
+	X(a, 10, 0, 0, 128, CV_RECOMPUTE)	/* EMF Feedback Cutout */ \
+	X(a, 11, 2, 0, 255, CV_RECOMPUTE)	/* Packet Time-Out Value */ \
+	X(a, 13, 0, 0, 255, 0)		/* Alt. Mode Func. Status F1-F8 */ \
+	X(a, 14, 0, 0, 255, 0)		/* Alt. Mode Func. Status FL,F9-F12 */ \
+	X(a, 17, 0xc0, 0xc0, 0xe7, CV_RECOMPUTE)	/* Extended Address */ \
+	X(a, 18, 0, 0, 255, CV_RECOMPUTE) \
+	X(a, 19, 0, 0, 255, CV_RECOMPUTE)	/* Consist Address */ \
+	X(a, 21, 0, 0, 255, CV_RECOMPUTE)	/* Consist Active F1-F8 */ \
+	X(a, 22, 0, 0, 63, CV_RECOMPUTE)	/* Consist Active FL,F9-F12 */ \
+	X(a, 27, 0, 0, 255, 0)		/* Automatic Stopping */ \
+	X(a, 29, CV29, 0, 255, CV_RECOMPUTE)	/* Configuration Data #1 */ \
+	X(a, 33, 0x01, 0, 255, CV_RECOMPUTE)	/* Output Locations FL(f) */ \
+	X(a, 34, 0x02, 0, 255, CV_RECOMPUTE)	/* FL(r) */ \
+	X(a, 35, 0x04, 0, 255, CV_RECOMPUTE)	/* F1 */ \
+	X(a, 36, 0x08, 0, 255, CV_RECOMPUTE) \
+	X(a, 37, 0x10, 0, 255, CV_RECOMPUTE) \
+	X(a, 38, 0x04, 0, 255, CV_RECOMPUTE)	/* F4 */ \
+	X(a, 39, 0x08, 0, 255, CV_RECOMPUTE) \
+	X(a, 40, 0x10, 0, 255, CV_RECOMPUTE) \
+	X(a, 41, 0x04, 0, 255, CV_RECOMPUTE)	/* F7 */ \
+	X(a, 42, 0x08, 0, 255, CV_RECOMPUTE) \
+	X(a, 43, 0x10, 0, 255, CV_RECOMPUTE) \
+	X(a, 44, 0x04, 0, 255, CV_RECOMPUTE)	/* F10 */ \
+	X(a, 45, 0x08, 0, 255, CV_RECOMPUTE) \
+	X(a, 46, 0x10, 0, 255, CV_RECOMPUTE)	/* F12 */ \
+	X(a, 50, 0, 0, 255, CV_RECOMPUTE)	/* Back EMF Kp, Ki */ \
+	X(a, 51, 0, 0, 255, CV_RECOMPUTE) \
+	X(a, 52, 200, 1, 255, CV_RECOMPUTE)	/* Back EMF at full speed */ \
+	X(a, 53, 2, 1, 255, CV_RECOMPUTE)	/* Control period, ticks */ \
+	X(a, 65, 0, 0, 255, CV_RECOMPUTE)	/* Kick Start */ \
+	X(a, 67, CV_SPEED_DEFAULT(0), 0, 255, CV_RECOMPUTE)	/* Speed Table */ \
+	X(a, 68, CV_SPEED_DEFAULT(1), 0, 255, CV_RECOMPUTE) \
+	X(a, 69, CV_SPEED_DEFAULT(2), 0, 255, CV_RECOMPUTE) \
+	X(a, 70, CV_SPEED_DEFAULT(3), 0, 255, CV_RECOMPUTE) \
+	X(a, 71, CV_SPEED_DEFAULT(4), 0, 255, CV_RECOMPUTE) \
+	X(a, 72, CV_SPEED_DEFAULT(5), 0, 255, CV_RECOMPUTE) \
+	X(a, 73, CV_SPEED_DEFAULT(6), 0, 255, CV_RECOMPUTE) \
+	X(a, 74, CV_SPEED_DEFAULT(7), 0, 255, CV_RECOMPUTE) \
+	X(a, 75, CV_SPEED_DEFAULT(8), 0, 255, CV_RECOMPUTE) \
+	X(a, 76, CV_SPEED_DEFAULT(9), 0, 255, CV_RECOMPUTE) \
+	X(a, 77, CV_SPEED_DEFAULT(10), 0, 255, CV_RECOMPUTE) \
+	X(a, 78, CV_SPEED_DEFAULT(11), 0, 255, CV_RECOMPUTE) \
+	X(a, 79, CV_SPEED_DEFAULT(12), 0, 255, CV_RECOMPUTE) \
+	X(a, 80, CV_SPEED_DEFAULT(13), 0, 255, CV_RECOMPUTE) \
+	X(a, 81, CV_SPEED_DEFAULT(14), 0, 255, CV_RECOMPUTE) \
+	X(a, 82, CV_SPEED_DEFAULT(15), 0, 255, CV_RECOMPUTE) \
+	X(a, 83, CV_SPEED_DEFAULT(16), 0, 255, CV_RECOMPUTE) \
+	X(a, 84, CV_SPEED_DEFAULT(17), 0, 255, CV_RECOMPUTE) \
+	X(a, 85, CV_SPEED_DEFAULT(18), 0, 255, CV_RECOMPUTE) \
+	X(a, 86, CV_SPEED_DEFAULT(19), 0, 255, CV_RECOMPUTE) \
+	X(a, 87, CV_SPEED_DEFAULT(20), 0, 255, CV_RECOMPUTE) \
+	X(a, 88, CV_SPEED_DEFAULT(21), 0, 255, CV_RECOMPUTE) \
+	X(a, 89, CV_SPEED_DEFAULT(22), 0, 255, CV_RECOMPUTE) \
+	X(a, 90, CV_SPEED_DEFAULT(23), 0, 255, CV_RECOMPUTE) \
+	X(a, 91, CV_SPEED_DEFAULT(24), 0, 255, CV_RECOMPUTE) \
+	X(a, 92, CV_SPEED_DEFAULT(25), 0, 255, CV_RECOMPUTE) \
+	X(a, 93, CV_SPEED_DEFAULT(26), 0, 255, CV_RECOMPUTE) \
+	X(a, 94, CV_SPEED_DEFAULT(27), 0, 255, CV_RECOMPUTE) \
+	X(a, 113, 0, 0, 7, CV_RECOMPUTE)	/* Light Effect, output 1 -> 6 */ \
+	X(a, 114, 0, 0, 7, CV_RECOMPUTE) \
+	X(a, 115, 0, 0, 7, CV_RECOMPUTE) \
+	X(a, 116, 0, 0, 7, CV_RECOMPUTE) \
+	X(a, 117, 0, 0, 7, CV_RECOMPUTE) \
+	X(a, 118, 0, 0, 7, CV_RECOMPUTE) \
+	X(a, 119, 255, 0, 255, CV_RECOMPUTE)	/* Brightness, output 1 -> 6 */ \
+	X(a, 120, 255, 0, 255, CV_RECOMPUTE) \
+	X(a, 121, 255, 0, 255, CV_RECOMPUTE) \
+	X(a, 122, 255, 0, 255, CV_RECOMPUTE) \
+	X(a, 123, 255, 0, 255, CV_RECOMPUTE) \
+	X(a, 124, 255, 0, 255, CV_RECOMPUTE)
+
+#endif				/* __DCC_CV_TABLE_H */
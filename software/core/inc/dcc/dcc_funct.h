@@ -10,6 +10,7 @@
 #define DCC_ENCODER_MAIN_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
 #define DCC_DC_RST      0x0
 #define DCC_DC_FTI      0x2
@@ -32,6 +33,11 @@ uint8_t decode(const uint8_t *buffer, uint8_t len, uint8_t check);
 
 uint8_t dcc_dec_ctrl(uint8_t instr, uint8_t data, uint8_t data_c);
 
+/**
+ * @brief Consist Control (0001)
+ * Sets CV#19 to the consist address in the data byte, bit 7 set if the
+ * direction is opposite (0011), or clears it when the address is 0.
+ */
 uint8_t dcc_cons_ctrl(uint8_t instr, uint8_t data, uint8_t data_c);
 
 /**
@@ -53,22 +59,27 @@ uint8_t dcc_cons_ctrl(uint8_t instr, uint8_t data, uint8_t data_c);
  * command station alternate speed packets. Decoders may ignore the direction
  * information transmitted in a broadcast packet for Speed and Direction
  * commands that do not contain stop or emergency stop information.
+ * FL is only controlled if mask allows it in the new direction, see
+ * dcc_fun_g1().
  */
-void dcc_vel_dir(uint8_t instr);
+void dcc_vel_dir(uint8_t instr, uint8_t mask);
 
 /**
  * @brief Function Group One Instruction (100)
  * Up to 5 auxiliary functions (functions FL and F1-F4) can be controlled by the
- * Function Group One instruction.
+ * Function Group One instruction. Only the functions set in mask (F4 F3 F2 F1
+ * as in the instruction, FL in the current direction of travel: bit 4
+ * forward, bit 5 reverse) are changed.
  */
-void dcc_fun_g1(uint8_t instr);
+void dcc_fun_g1(uint8_t instr, uint8_t mask);
 
 /**
- * @brief Function Group One Instruction (101)
+ * @brief Function Group Two Instruction (101)
  * Up to 8 additional auxiliary functions (F5-F12) can be controlled by a
- * Function Group Two instruction. Bit 4 defines the use of Bits 0-3.
+ * Function Group Two instruction. Bit 4 defines the use of Bits 0-3: F5-F8
+ * when set, F9-F12 when clear. Only the bits set in mask are changed.
  */
-void dcc_fun_g2(uint8_t instr);
+void dcc_fun_g2(uint8_t instr, uint8_t mask);
 
 /**
  * @brief Binary State Control Instruction long form
@@ -132,11 +143,33 @@ uint8_t dcc_ana_fun_g(const uint8_t *buffer, uint8_t data_c);
  */
 uint8_t dcc_cv_acc_s(uint8_t instr, const uint8_t *buffer, uint8_t data_c);
 
+/**
+ * Operations mode (programming on the main) CV accesses. Writes only reach
+ * the EEPROM once the burst is over, see cv_commit_poll().
+ */
+struct pom_stats {
+	uint16_t writes;	/* CVs or bits written */
+	uint16_t rejected;	/* read only, unimplemented or out of range */
+	uint16_t verifies;
+	uint16_t mismatches;	/* verifies that would not be acknowledged */
+};
+
+extern struct pom_stats pom_stats;
+
 /**
  * @brief Configuration Variable Access Instruction - Long Form
+ * @description Byte verify, byte write and bit manipulation in operations
+ * mode. A write is executed on the second of two identical packets.
  */
 uint8_t dcc_cv_acc_l(uint8_t instr, const uint8_t *buffer, uint8_t data_c);
 
+/**
+ * @brief Ends the current run of long form CV accesses: called for every
+ * other packet to this decoder, so that only back-to-back packets count as
+ * repeats.
+ */
+void dcc_cv_acc_end(void);
+
 
 enum dec_res {
         DCC_OK, DCC_IDLE, DCC_IGNORE, DCC_ERROR
@@ -12,6 +12,8 @@
 #include <stdint.h>
 #include <stdbool.h>
 
+#include "packet_queue.h"
+
 #define DCC_DCCI        0x00     // Decoder and Consist Control Instruction
 #define DCC_AOI         0x20     // Advanced Operation Instructions
 #define DCC_SDIR        0x40     // Speed and Direction Instruction for reverse operation
@@ -22,21 +24,224 @@
 #define DCC_CVAI        0xE0     // Configuration Variable Access Instruction
 
 
+/* Pulse classes: a half-bit is either part of a 1, part of a 0 or invalid */
+enum pulse_class {PULSE_ONE, PULSE_ZERO, PULSE_INVALID, PULSE_CLASSES};
+
+/* Half-bit durations below this are classified by table lookup */
+#define PULSE_LUT_LEN		128
+
+/* pulse_lut[] entries: the class, and above it the bin of track_diag.h */
+#define PULSE_CLASS_MASK	0x03
+#define PULSE_BIN_SHIFT		2
+
+/**
+ * Receiver states: the phase of the packet, ORed with the half-bit already
+ * received. PRE counts the ones of the preamble, DATA shifts in the eight bits
+ * of a byte, SEP waits for the bit after a byte: a 0 starts another byte, a 1
+ * ends the packet.
+ */
+#define RX_H1			0x01	/* first half of a 1 received */
+#define RX_H0			0x02	/* first half of a 0 received */
+#define RX_HALF			0x03
+#define RX_PHASE		0x0c
+
+enum rx_state {
+	RX_PRE = 0x00,
+	RX_DATA = 0x04,
+	RX_SEP = 0x08,
+	RX_STATES = 0x0c
+};
+
+#define PREAMBLE_MIN		10	/* ones required before the first 0 */
+
+/**
+ * Address of the packet being received, classified as soon as its address
+ * byte(s) are complete. Foreign and idle packets are dropped there, before
+ * the rest of the packet is stored and checked.
+ */
+enum rx_addr {
+	RX_ADDR_PENDING,	/* address not complete yet */
+	RX_ADDR_OURS,
+	RX_ADDR_BROADCAST,
+	RX_ADDR_IDLE,
+	RX_ADDR_FOREIGN
+};
+
+/**
+ * Addresses the decoder answers to, rebuilt by decoder_address_update() when
+ * CV#1, CV#17-19, CV#21-22 or CV#29 change. A received address is turned into
+ * a key, the short address or the long one ORed with DCC_ADDR_LONG, so that
+ * matching it takes two compares whatever the configuration.
+ */
+#define DCC_ADDR_LONG		0x8000u
+#define DCC_ADDR_NONE		0xffffu	/* matches no key */
+
+enum dcc_addr_match {
+	DCC_ADDR_OTHER,
+	DCC_ADDR_OWN,		/* primary or long address, broadcast */
+	DCC_ADDR_CONSIST,
+	DCC_ADDR_MATCHES
+};
+
+/**
+ * What a packet may do, by the address it came to: the function state bits
+ * it may change (F4-F1, F5-F8 and F9-F12, as in the instructions) and
+ * whether its direction is reversed. FL has a bit per direction of travel in
+ * fg1, bit 4 forward and bit 5 reverse, as in CV#22.
+ */
+struct dcc_addr_mode {
+	uint8_t fg1;
+	uint8_t f5_8;
+	uint8_t f9_12;
+	bool reverse;
+};
+
+struct dcc_addr_set {
+	uint16_t own;		/* CV#1, or CV#17-18 if CV#29 bit 5 is set */
+	uint16_t consist;	/* CV#19, DCC_ADDR_NONE if not in a consist */
+	struct dcc_addr_mode mode[DCC_ADDR_MATCHES];
+};
+
+extern struct dcc_addr_set addr1;
+
+static inline uint8_t dcc_addr_match(uint16_t key)
+{
+	if (key == addr1.own)
+		return DCC_ADDR_OWN;
+	if (key == addr1.consist)
+		return DCC_ADDR_CONSIST;
+
+	return DCC_ADDR_OTHER;
+}
+
 struct decoder
 {
-	uint8_t bytes[16];
+	uint8_t bytes[DCC_PACKET_MAX];
 	uint8_t N, byte_n;
 	uint8_t actual_byte;
+	uint8_t state;
+	uint8_t addr;
 	uint16_t T_prev;
-	bool half0, half1, has_preamble;
+	bool synced;		/* at the end of a packet: a preamble follows */
+	volatile bool service;	/* service mode: 0111xxxx is not an address */
+};
+
+/**
+ * Receiver counters by cause. Each one has a single writer, the receiver in
+ * PendSV or decoder_poll() in the main loop, so they are plain increments.
+ * At 32 bits they outlast any session: the busiest, foreign, takes years of
+ * back-to-back packets to wrap. The command station reads them as
+ * CV#129 -> CV#172, four CVs per counter, high byte first, in this order
+ * followed by the overflows of pq1.
+ */
+struct rx_stats {
+	uint32_t packets;	/* preambles accepted */
+	uint32_t accepted;	/* executed by decode() */
+	uint32_t ignored;	/* dropped by decode(), e.g. by the consist */
+	uint32_t foreign;	/* dropped by address in the receiver */
+	uint32_t idle;
+	uint32_t checksum;	/* checksum or length errors in decode() */
+	uint32_t preamble;	/* fewer than PREAMBLE_MIN ones after a packet */
+	uint32_t symmetry;	/* halves of a 1 more than ONE_DELTA apart */
+	uint32_t framing;	/* invalid pulse, 0 or packet too long */
+	uint32_t gaps;		/* TIM2 periods without edges */
 };
 
+#define CV_RX_STATS		129
+#define RX_STATS_COUNTERS	(sizeof(struct rx_stats) / sizeof(uint32_t) + 1)
+#define CV_RX_STATS_LAST	(CV_RX_STATS + 4 * RX_STATS_COUNTERS - 1)
+
+extern struct rx_stats rx_stats;
+
+/**
+ * Repeat suppression: the last payload (instruction and data bytes) executed
+ * for each class of refreshed instruction. A byte-identical repeat is not
+ * dispatched again. Stop, emergency stop and decoder control packets are
+ * never looked up and flush the cache, so the next refresh runs again. The
+ * same payload sent to the consist address is a different instruction.
+ */
+enum dcc_cache_slot {
+	DCC_CACHE_SPEED,	/* 14/28/128 step speed: one motor target */
+	DCC_CACHE_FG1,		/* FL, F1-F4 */
+	DCC_CACHE_FG2_LO,	/* F5-F8 */
+	DCC_CACHE_FG2_HI,	/* F9-F12 */
+	DCC_CACHE_F13_20,
+	DCC_CACHE_F21_28,
+	DCC_CACHE_SLOTS,
+	DCC_CACHE_NONE = DCC_CACHE_SLOTS,	/* not cached */
+	DCC_CACHE_BYPASS			/* safety critical */
+};
+
+#define DCC_CACHE_PAYLOAD	2
+
+struct dcc_cache_entry {
+	uint8_t len;		/* 0: empty */
+	uint8_t match;		/* address it came to, enum dcc_addr_match */
+	uint8_t payload[DCC_CACHE_PAYLOAD];
+};
+
+struct dcc_cache_stats {
+	uint16_t hits;		/* repeats not dispatched */
+	uint16_t misses;	/* cacheable packets dispatched */
+	uint16_t bypassed;	/* stop, e-stop and decoder control */
+};
+
+extern struct dcc_cache_stats dcc_cache_stats;
+
+extern struct decoder dec1;
+
+/* Packets received, waiting for decode() in the main loop */
+extern struct packet_queue pq1;
+
+extern uint8_t pulse_lut[PULSE_LUT_LEN];
+
+extern const uint32_t ZERO_MAX;
+
+static inline uint8_t pulse_class(uint16_t T)
+{
+	if (T < PULSE_LUT_LEN)
+		return pulse_lut[T] & PULSE_CLASS_MASK;
+
+	return (T < ZERO_MAX) ? PULSE_ZERO : PULSE_INVALID;
+}
+
+/**
+ * @brief Builds the pulse classification table and resets the receiver.
+ */
+void decoder_init(void);
+
 void decoder_reset(struct decoder *dec);
 
+/**
+ * @brief Rebuilds the address set if it depends on CV num, or
+ * unconditionally when num is 0.
+ */
+void decoder_address_update(uint16_t num);
+
+/**
+ * @brief Hands a completed packet over to the main loop. Called from the ISR.
+ */
 void decoder_end(struct decoder *dec);
 
+/**
+ * @brief Decodes and executes the packets queued by the receiver. Called from
+ * the main loop, so that the instruction handlers never run inside the ISR.
+ */
+void decoder_poll(void);
+
 uint8_t decode(const uint8_t *buffer, uint8_t len, uint8_t check);
 
+/**
+ * @brief Forgets the cached payloads, so that the next refresh of every
+ * instruction is executed. For state changed outside decode().
+ */
+void dcc_cache_flush(void);
+
+/**
+ * @returns: byte of a receiver counter, for CV#129 -> CV#172.
+ */
+uint8_t rx_stats_cv(uint16_t num);
+
 void interrupt_funct(uint16_t T);
 
 #endif //__DCC_DECODER_H
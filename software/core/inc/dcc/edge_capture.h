@@ -0,0 +1,68 @@
+/*******************************************************************************
+ * @file    :   edge_capture.h
+ * @brief   :   Timestamp ring between the DCC edge interrupt and the receiver
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_EDGE_CAPTURE_H
+#define __DCC_EDGE_CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "main.h"
+
+/* Must be a power of two */
+#define EDGE_RING_LEN		64
+
+/**
+ * The edge interrupt only stores the free-running TIM2 count of each edge;
+ * the receiver consumes the differences in batches from PendSV, which is
+ * pended every time half of the ring has been filled (the same scheme as the
+ * half/full-transfer interrupts of a circular DMA) and on every TIM2 update.
+ */
+struct edge_ring
+{
+	volatile uint16_t ts[EDGE_RING_LEN];
+	volatile uint8_t head;		/* written by the edge ISR only */
+	uint8_t tail;			/* written by the consumer only */
+	uint8_t update_head;		/* head seen at the last TIM2 update */
+	volatile bool gap;		/* a whole TIM2 period without edges */
+	volatile uint8_t idle_periods;	/* consecutive periods without edges */
+	bool sync;			/* next edge only gives the reference */
+	uint16_t prev;			/* timestamp of the last consumed edge */
+	uint16_t overruns;		/* edges lost because the ring was full */
+	uint16_t batches;
+};
+
+extern struct edge_ring er1;
+
+/**
+ * @brief Records the timestamp of an edge. Called from the edge ISR.
+ */
+static inline void edge_capture(uint16_t ts)
+{
+	uint8_t head = er1.head + 1;
+
+	er1.ts[head & (EDGE_RING_LEN - 1)] = ts;
+	er1.head = head;
+
+	if ((head & (EDGE_RING_LEN / 2 - 1)) == 0)
+		SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
+
+/**
+ * @brief Feeds the receiver with the pulse widths of the captured edges.
+ * Called from PendSV, at the lowest interrupt priority.
+ */
+void edge_drain(void);
+
+/**
+ * @brief Flushes the ring and detects the loss of the signal. Called on every
+ * TIM2 update, i.e. every 65.536 ms.
+ */
+void edge_timer_update(void);
+
+#endif //__DCC_EDGE_CAPTURE_H
@@ -0,0 +1,58 @@
+/*******************************************************************************
+ * @file    :   function_map.h
+ * @brief   :   Function to output mapping, CV#33 -> CV#46
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_FUNCTION_MAP_H
+#define __DCC_FUNCTION_MAP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * Function state changes applied to the outputs.
+ */
+struct fn_stats {
+	uint32_t updates;
+};
+
+extern struct fn_stats fn_stats;
+
+/**
+ * @brief Rebuilds the function to output matrix if it depends on CV num
+ * (the output locations and CV#29), or unconditionally when num is 0.
+ */
+void fn_map_update(uint16_t num);
+
+/**
+ * @brief Function Group One, bits 0-3 F1-F4 and bit 4 FL. FL is only taken
+ * from here in 28/128 speed step mode (CV#29 bit 1). Functions not set in
+ * mask keep their state.
+ */
+void fn_group1(uint8_t fun, uint8_t mask);
+
+/**
+ * @brief Function Group Two, bit 4 selects F5-F8 (1) or F9-F12 (0), whose
+ * bits not set in mask keep their state.
+ */
+void fn_group2(uint8_t fun, uint8_t mask);
+
+/**
+ * @brief FL from bit 4 of a 14 speed step instruction.
+ */
+void fn_light(bool on);
+
+/**
+ * @brief Direction of travel, which selects FL(f) or FL(r).
+ */
+void fn_direction(bool reverse);
+
+/**
+ * @returns: the direction of travel, true in reverse.
+ */
+bool fn_reverse(void);
+
+#endif //__DCC_FUNCTION_MAP_H
@@ -0,0 +1,87 @@
+/*******************************************************************************
+ * @file    :   lights.h
+ * @brief   :   Function outputs and their lighting effects
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_LIGHTS_H
+#define __DCC_LIGHTS_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "motor.h"
+
+/* Physical outputs, numbered as the output locations of S-9.2.2 */
+#define LIGHT_OUTPUTS		6
+
+/* PWM slots of an output, one TIM21 compare each: one PWM period per tick */
+#define LIGHT_SLOT_US		250
+#define LIGHT_SLOTS		(MOTOR_TICK_US / LIGHT_SLOT_US)
+
+/* Manufacturer CVs, one per output */
+#define CV_LIGHT_EFFECT		113	/* CV#113 -> CV#118, enum light_effect */
+#define CV_LIGHT_BRIGHTNESS	119	/* CV#119 -> CV#124, 255: full */
+
+enum light_effect {
+	LIGHT_STEADY,		/* on/off, dimmed by the brightness CV */
+	LIGHT_FADE,		/* fades in and out */
+	LIGHT_FLICKER,		/* firebox, oil lamp */
+	LIGHT_STROBE,
+	LIGHT_DOUBLE_STROBE,
+	LIGHT_MARS,		/* oscillating, never fully off */
+	LIGHT_DITCH_A,		/* alternating, phase A */
+	LIGHT_DITCH_B,		/* alternating, phase B */
+	LIGHT_EFFECTS
+};
+
+/**
+ * Output stage counters: port writes of steady outputs, PWM slots played and
+ * pattern slots rewritten by the effects.
+ */
+struct light_stats {
+	uint32_t port_writes;
+	uint32_t slots;
+	uint32_t patches;
+};
+
+extern struct light_stats light_stats;
+
+/**
+ * @returns: the pin of output out (0 -> LIGHT_OUTPUTS - 1), GPIOA pins in the
+ * low half word and GPIOB pins in the high one.
+ */
+uint32_t light_output_word(uint8_t out);
+
+/**
+ * @brief Rebuilds the effects and the PWM pattern if they depend on CV num,
+ * or unconditionally when num is 0.
+ */
+void light_update(uint16_t num);
+
+/**
+ * @brief Sets the outputs to on (as light_output_word()): steady outputs are
+ * written at once, the others follow their effect from the next tick.
+ */
+void light_outputs(uint32_t on);
+
+/**
+ * @brief Advances the effects, once per motor tick. Called from the main
+ * loop scheduler.
+ */
+void light_tick(void);
+
+/**
+ * @brief Plays the next PWM slot, on the TIM21 channel 1 compare.
+ */
+void light_slot(void);
+
+/**
+ * @returns: true if all the outputs in the PWM pattern are off, so it can
+ * stop.
+ */
+bool light_idle(void);
+
+#endif //__DCC_LIGHTS_H
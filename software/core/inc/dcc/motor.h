@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * @file    :   motor.h
+ * @brief   :   Momentum engine and motor PWM on TIM22
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_MOTOR_H
+#define __DCC_MOTOR_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Speed steps in every speed mode are scaled to 0 -> MOTOR_STEPS */
+#define MOTOR_STEPS		126
+
+/* Period of motor_tick(), from TIM21: 128 ticks are 0.896 s, the CV#3 unit */
+#define MOTOR_TICK_US		7000
+
+/* TIM22 counts to ARR = 128: a compare value of MOTOR_PWM_TOP is 100% */
+#define MOTOR_PWM_TOP		129
+
+/**
+ * Cost of motor_tick(), in core cycles measured on SysTick.
+ */
+struct motor_stats {
+	uint32_t ticks;
+	uint16_t tick_cycles;		/* last tick */
+	uint16_t tick_cycles_max;
+};
+
+extern struct motor_stats motor_stats;
+
+/**
+ * @brief Reloads the acceleration and deceleration rates (CV#3, CV#4) and
+ * the direction of travel (CV#29 bit 0). Called when one of them changes.
+ */
+void motor_config(void);
+
+/**
+ * @brief Sets the speed to reach at the CV#3/CV#4 rates, in steps of
+ * 1/MOTOR_STEPS of full speed. A change of direction first ramps down to 0.
+ */
+void motor_set(uint8_t step, bool reverse);
+
+/**
+ * @brief Ramps down to 0 at the CV#4 rate, keeping the direction.
+ */
+void motor_stop(void);
+
+/**
+ * @brief Stops immediately, without deceleration.
+ */
+void motor_estop(void);
+
+/**
+ * @brief Advances the ramp by one step and updates the PWM. Called from the
+ * TIM21 interrupt every MOTOR_TICK_US.
+ */
+void motor_tick(void);
+
+/**
+ * @returns: the current internal speed step.
+ */
+uint8_t motor_step(void);
+
+/**
+ * @brief Turns the bridge back on after a back EMF window.
+ */
+void motor_resume(void);
+
+/**
+ * @brief Drives the motor at full power while on, for the service mode ACK.
+ * Called from the TIM21 interrupt, like motor_tick().
+ */
+void motor_pulse(bool on);
+
+/**
+ * @returns: true if the motor is stopped and not commanded to move.
+ */
+bool motor_idle(void);
+
+#endif //__DCC_MOTOR_H
@@ -0,0 +1,57 @@
+/*******************************************************************************
+ * @file    :   packet_queue.h
+ * @brief   :   Lock-free queue of the packets received by the bit receiver
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_PACKET_QUEUE_H
+#define __DCC_PACKET_QUEUE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Must be a power of two */
+#define PACKET_QUEUE_LEN	8
+
+#define DCC_PACKET_MAX		16
+
+struct dcc_packet
+{
+	uint8_t bytes[DCC_PACKET_MAX];
+	uint8_t len;
+	uint16_t end;		/* TIM2 count of the edge ending the packet */
+};
+
+/**
+ * Single-producer/single-consumer ring: the receiver ISR only writes head, the
+ * main loop only writes tail, so no lock is needed on a single core.
+ */
+struct packet_queue
+{
+	struct dcc_packet slot[PACKET_QUEUE_LEN];
+	volatile uint8_t head, tail;
+	volatile uint16_t overflows;	/* packets dropped because full */
+	uint8_t max_depth;		/* highest number of queued packets */
+};
+
+/**
+ * @brief Appends a packet to the queue. Producer side, called from the ISR.
+ * @returns: false if the queue was full and the packet has been dropped.
+ */
+bool pq_push(struct packet_queue *q, const uint8_t *bytes, uint8_t len,
+	     uint16_t end);
+
+/**
+ * @brief Oldest packet in the queue, or NULL if it is empty. Consumer side.
+ * The slot stays valid until pq_pop() is called.
+ */
+const struct dcc_packet *pq_peek(struct packet_queue *q);
+
+/**
+ * @brief Releases the slot returned by pq_peek(). Consumer side.
+ */
+void pq_pop(struct packet_queue *q);
+
+#endif //__DCC_PACKET_QUEUE_H
@@ -0,0 +1,57 @@
+/*******************************************************************************
+ * @file    :   service_mode.h
+ * @brief   :   Service mode (S-9.2.3): direct mode CV access and ACK pulse
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_SERVICE_MODE_H
+#define __DCC_SERVICE_MODE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "packet_queue.h"
+
+/* Service mode ends after this long without a reset or service packet */
+#define SVC_TIMEOUT_US		20000
+
+/**
+ * The ACK starts this long after the end of the packet, whatever the decode
+ * latency: the receiver sees the end of a packet within 32 edges of the next
+ * preamble, under 2 ms.
+ */
+#define SVC_ACK_DELAY_US	2500
+#define SVC_ACK_US		6000	/* 6 ms +-1 ms of motor current */
+
+struct svc_stats {
+	uint16_t entries;
+	uint16_t packets;	/* direct mode instructions */
+	uint16_t writes;	/* CVs or bits written */
+	uint16_t acks;
+	uint16_t late;		/* ACKs started after SVC_ACK_DELAY_US */
+};
+
+extern struct svc_stats svc_stats;
+
+/**
+ * @brief Handles a received packet if it belongs to service mode: a run of
+ * reset packets enters it, direct mode packets are executed while in it, any
+ * other packet leaves it. Called by decoder_poll() before decode().
+ * @returns: true if the packet has been consumed.
+ */
+bool svc_packet(const struct dcc_packet *p);
+
+/**
+ * @brief Starts or ends the ACK pulse, on the TIM21 channel 2 compare.
+ */
+void svc_timer(void);
+
+/**
+ * @brief Leaves service mode if no packet came for a whole TIM2 period.
+ * Called on every TIM2 update.
+ */
+void svc_timer_update(void);
+
+#endif //__DCC_SERVICE_MODE_H
@@ -0,0 +1,39 @@
+/*******************************************************************************
+ * @file    :   speed_table.h
+ * @brief   :   Speed step to motor duty lookup table
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_SPEED_TABLE_H
+#define __DCC_SPEED_TABLE_H
+
+#include <stdint.h>
+
+#include "motor.h"
+
+/* One entry per internal speed step, 0 -> MOTOR_STEPS, padded */
+#define SPEED_LUT_LEN		128
+
+/* Ticks of motor_tick() the CV#65 kick lasts when starting from stop */
+#define SPEED_KICK_TICKS	3
+
+/**
+ * Duty (0 -> MOTOR_PWM_TOP) of every internal speed step, following the
+ * speed table CV#67 -> CV#94 if CV#29 bit 4 is set, the Vstart/Vmid/Vhigh
+ * curve of CV#2, CV#6 and CV#5 otherwise. Kept up to date by
+ * speed_table_update(): the motor only loads from it.
+ */
+extern uint8_t speed_lut[SPEED_LUT_LEN];
+
+/* Duty of the CV#65 kick start */
+extern uint8_t speed_kick;
+
+/**
+ * @brief Rebuilds the part of the table that depends on CV num, or all of it
+ * when num is 0.
+ */
+void speed_table_update(uint16_t num);
+
+#endif //__DCC_SPEED_TABLE_H
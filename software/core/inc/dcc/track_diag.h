@@ -0,0 +1,107 @@
+/*******************************************************************************
+ * @file    :   track_diag.h
+ * @brief   :   Pulse width histogram and signal quality of the track
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_TRACK_DIAG_H
+#define __DCC_TRACK_DIAG_H
+
+#include <stdint.h>
+
+#include "decoder.h"
+
+/**
+ * Half-bit widths, log binned: four bins per octave from 16 us to 4095 us.
+ * The first and the last bin also take the pulses below and above.
+ */
+#define DIAG_BINS		32
+#define DIAG_T_MIN		16
+#define DIAG_T_MAX		4096
+
+/* Manufacturer CVs, read only */
+#define CV_DIAG_HIST		173	/* CV#173 -> CV#236, 2 per bin */
+#define CV_DIAG_SIGNAL		237	/* CV#237 -> CV#241 */
+#define CV_DIAG_LAST		241
+
+/**
+ * Everything but the histogram bins is in 1/16 us, as exponential averages
+ * over the last 16 bits or so. When pulses wraps, the bins, pulses and
+ * invalid are halved together, so they keep their proportions.
+ */
+struct diag {
+	uint16_t hist[DIAG_BINS];
+	uint16_t pulses;
+	uint16_t invalid;	/* out of every window */
+	uint16_t period;	/* of a 1 */
+	uint16_t jitter;	/* |period - average| */
+	uint16_t asym;		/* |second half - first half| of a 1 */
+};
+
+extern struct diag diag1;
+
+/* Bin of the widths from PULSE_LUT_LEN to DIAG_T_MAX, by T >> 5 */
+extern uint8_t diag_bin_hi[DIAG_T_MAX >> 5];
+
+/**
+ * @returns: the histogram bin of a pulse of T us. Slow, for building the
+ * lookup tables.
+ */
+uint8_t diag_bin(uint16_t T);
+
+/**
+ * @brief Builds diag_bin_hi[] and clears the statistics.
+ */
+void diag_init(void);
+
+void diag_halve(void);
+
+/**
+ * @brief Counts a pulse. Called by the receiver for every edge: the bin of
+ * the short pulses comes with their class from pulse_lut[].
+ */
+static inline void diag_pulse(uint16_t T, uint8_t cls)
+{
+	uint8_t bin;
+
+	if (T < PULSE_LUT_LEN)
+		bin = pulse_lut[T] >> PULSE_BIN_SHIFT;
+	else if (T < DIAG_T_MAX)
+		bin = diag_bin_hi[T >> 5];
+	else
+		bin = DIAG_BINS - 1;
+
+	diag1.hist[bin]++;
+	if (cls == PULSE_INVALID)
+		diag1.invalid++;
+	if (++diag1.pulses == 0)
+		diag_halve();
+}
+
+/**
+ * @brief Updates the averages with a valid 1 of halves T_prev and T.
+ */
+static inline void diag_one(uint16_t T, uint16_t T_prev)
+{
+	int16_t d = (int16_t) ((T + T_prev) << 4) - (int16_t) diag1.period;
+	int16_t a = (int16_t) ((T - T_prev) << 4);
+
+	/* Rounded: truncation would drag the averages down */
+	diag1.period += (d + 8) >> 4;
+	if (d < 0)
+		d = -d;
+	diag1.jitter += (d - (int16_t) diag1.jitter + 8) >> 4;
+	if (a < 0)
+		a = -a;
+	diag1.asym += (a - (int16_t) diag1.asym + 8) >> 4;
+}
+
+/**
+ * @returns: byte of the histogram or of the signal quality, for
+ * CV#173 -> CV#241.
+ */
+uint8_t diag_cv(uint16_t num);
+
+#endif //__DCC_TRACK_DIAG_H
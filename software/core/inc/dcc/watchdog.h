@@ -0,0 +1,67 @@
+/*******************************************************************************
+ * @file    :   watchdog.h
+ * @brief   :   Packet time-out (CV#11) and loss of the DCC signal
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __DCC_WATCHDOG_H
+#define __DCC_WATCHDOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CV_PACKET_TIMEOUT	11	/* seconds, 0: never */
+
+/* TIM2 periods (65.536 ms) without any edge before the track is called DC */
+#define WD_DC_PERIODS		3
+
+struct watchdog {
+	volatile uint16_t periods;	/* TIM2 updates since our last packet */
+	uint16_t timeout;		/* CV#11 in TIM2 periods, 0: off */
+	bool expired;			/* stopped until the next packet */
+	bool dc;			/* DC on the track */
+};
+
+extern struct watchdog wd1;
+
+/**
+ * Fail-safe events: time-outs are counted when CV#11 expires, dc when the
+ * track goes from DCC to a steady level.
+ */
+struct wd_stats {
+	uint16_t timeouts;
+	uint16_t dc;
+};
+
+extern struct wd_stats wd_stats;
+
+/**
+ * @brief Restarts the time-out. Called by decode() for every valid packet
+ * addressed to the decoder.
+ */
+static inline void wd_packet(void)
+{
+	wd1.periods = 0;
+	wd1.expired = false;
+}
+
+/**
+ * @brief Reloads the time-out if CV num is CV#11, or unconditionally when
+ * num is 0.
+ */
+void wd_update(uint16_t num);
+
+/**
+ * @brief Counts the time since the last packet. Called on every TIM2 update.
+ */
+void wd_timer_update(void);
+
+/**
+ * @brief Ramps the motor down at the CV#4 rate if CV#11 expired or the track
+ * went DC. Called from the main loop.
+ */
+void wd_poll(void);
+
+#endif //__DCC_WATCHDOG_H
@@ -0,0 +1,77 @@
+/*******************************************************************************
+ * @file    :   latency.h
+ * @brief   :   Edge interrupt latency probe, built with LATENCY_PROBE
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __LATENCY_H
+#define __LATENCY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "main.h"
+
+/**
+ * The probe pin goes high when the edge interrupt has taken its timestamp and
+ * low when it returns: on a scope, the delay from the edge on DCC_DATA is the
+ * entry-to-capture latency, the pulse the rest of the handler. PluX16 AUX2
+ * must be left unmapped (CV#33 -> CV#46) while probing.
+ */
+#define LATENCY_PROBE_PORT	C_AUX2_GPIO_Port
+#define LATENCY_PROBE_PIN	C_AUX2_Pin
+
+#define LATENCY_SAMPLES		64
+
+/**
+ * Software triggered edges, in core cycles from the EXTI SWIER write to the
+ * timestamp. The write itself adds a few constant cycles: compare builds
+ * (HOT_RAM or not) with each other rather than with the datasheet.
+ */
+struct latency_stats {
+	uint16_t samples;
+	uint16_t min, max;
+	uint32_t total;
+};
+
+extern struct latency_stats latency_stats;
+
+/* SysTick value at the timestamp of the last software triggered edge */
+extern volatile uint32_t latency_at;
+
+/**
+ * @brief Raises the probe pin. Called by the edge interrupt right after the
+ * timestamp.
+ * @returns: true for a software triggered edge, which is not captured.
+ */
+static inline bool latency_capture(void)
+{
+	uint32_t now = SysTick->VAL;
+
+	LATENCY_PROBE_PORT->BSRR = LATENCY_PROBE_PIN;
+
+	/* Only a software trigger sets SWIER, cleared with the pending bit */
+	if (!(EXTI->SWIER & DCC_DATA_Pin))
+		return false;
+
+	latency_at = now;
+	return true;
+}
+
+/**
+ * @brief Lowers the probe pin, when the edge interrupt returns.
+ */
+static inline void latency_release(void)
+{
+	LATENCY_PROBE_PORT->BRR = LATENCY_PROBE_PIN;
+}
+
+/**
+ * @brief Triggers LATENCY_SAMPLES edges from software and records their
+ * latency in latency_stats. Called once at start up.
+ */
+void latency_measure(void);
+
+#endif //__LATENCY_H
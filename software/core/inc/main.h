@@ -25,8 +25,62 @@
 
 #include "stm32l0xx_hal.h"
 
+#include <stdbool.h>
+
+/**
+ * Receiver hot path: with HOT_RAM, the functions copied to RAM by
+ * Reset_Handler (.ramfunc), away from the flash wait state, and the tables
+ * they read on every edge.
+ */
+#ifdef HOT_RAM
+#define RAMFUNC		__attribute__((section(".ramfunc")))
+#define RAMDATA		__attribute__((section(".ramfunc.data")))
+#else
+#define RAMFUNC
+#define RAMDATA
+#endif
+
 void Error_Handler(void);
 
+void SystemClock_Config(void);
+
+/* Slots of the main loop scheduler, in the order they run */
+enum task_id {
+	TASK_PACKETS,		/* decoder_poll() */
+	TASK_WATCHDOG,		/* wd_poll() */
+	TASK_LIGHTS,		/* light_tick() */
+	TASK_COMMIT,		/* cv_commit_poll() */
+	TASK_CLOCK,		/* clock_trim_poll() */
+	TASK_TELEMETRY,
+	TASKS
+};
+
+/**
+ * Run-time accounting of a task, on TIM2 (1 us). run_us wraps: read it as a
+ * difference.
+ */
+struct task_stats {
+	uint32_t runs;
+	uint32_t run_us;
+	uint16_t max_us;
+	uint16_t misses;	/* over the deadline, or a release lost */
+};
+
+extern struct task_stats task_stats[TASKS];
+
+/* Time spent in the tasks over the last telemetry period, in % */
+extern uint8_t sched_load;
+
+/**
+ * @brief Releases the periodic tasks. Called on every TIM21 update.
+ */
+void sched_tick(void);
+
+/**
+ * @returns: true if a periodic task has been released and not run yet.
+ */
+bool sched_pending(void);
+
 /* Front headlight - PluX16 pin 7 */
 #define C_FOF_Pin GPIO_PIN_0
 #define C_FOF_GPIO_Port GPIOA
@@ -45,6 +99,9 @@ void Error_Handler(void);
 #define IN_1_GPIO_Port GPIOA
 #define IN_2_Pin GPIO_PIN_7
 #define IN_2_GPIO_Port GPIOA
+/* Motor back EMF divider, not fitted on the first board revision */
+#define BEMF_Pin GPIO_PIN_4
+#define BEMF_GPIO_Port GPIOA
 /* PluX16 pins 16 and 18 */
 #define C_AUX1_Pin GPIO_PIN_0
 #define C_AUX1_GPIO_Port GPIOB
@@ -0,0 +1,45 @@
+/*******************************************************************************
+ * @file    :   power.h
+ * @brief   :   Low-power idle of the main loop
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#ifndef __POWER_H
+#define __POWER_H
+
+#include <stdint.h>
+
+/**
+ * Stop is only entered after this many TIM2 periods (65.536 ms each) without
+ * a DCC edge, i.e. with the track signal lost.
+ */
+#define POWER_STOP_PERIODS	2
+
+/**
+ * Residency counters. Times come from TIM2 (1 µs) and wrap about every 71
+ * minutes: read them as differences. TIM2 does not run in Stop, so time spent
+ * there is in neither counter.
+ */
+struct power_stats {
+	uint32_t run_us;	/* awake in the main loop or in interrupts */
+	uint32_t sleep_us;	/* core stopped in Sleep */
+	uint16_t sleeps;
+	uint16_t stops;
+};
+
+extern struct power_stats power_stats;
+
+/**
+ * @brief Selects the clock used when waking up from Stop.
+ */
+void power_init(void);
+
+/**
+ * @brief Puts the core to sleep until the next interrupt, unless there is
+ * work pending. Called at the end of every main loop iteration.
+ */
+void power_idle(void);
+
+#endif //__POWER_H
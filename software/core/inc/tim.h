@@ -24,10 +24,14 @@
 
 extern TIM_HandleTypeDef htim2;
 
+extern TIM_HandleTypeDef htim21;
+
 extern TIM_HandleTypeDef htim22;
 
 void MX_TIM2_Init(void);
 
+void MX_TIM21_Init(void);
+
 void MX_TIM22_Init(void);
 
 void HAL_TIM_MspPostInit(TIM_HandleTypeDef *htim);
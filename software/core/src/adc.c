@@ -0,0 +1,98 @@
+/**
+  ******************************************************************************
+  * @file    adc.c
+  * @brief   This file provides code for the configuration
+  *          of the ADC instances.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include "adc.h"
+
+ADC_HandleTypeDef hadc;
+DMA_HandleTypeDef hdma_adc;
+
+/* ADC init function */
+void MX_ADC_Init(void)
+{
+	ADC_ChannelConfTypeDef sConfig = {0};
+
+	/**
+	 * Back EMF: one conversion on every TIM22 update while the bridge is
+	 * off, moved to memory by DMA1 channel 1
+	 */
+	hadc.Instance = ADC1;
+	hadc.Init.OversamplingMode = DISABLE;
+	hadc.Init.ClockPrescaler = ADC_CLOCK_SYNC_PCLK_DIV2;
+	hadc.Init.Resolution = ADC_RESOLUTION_12B;
+	hadc.Init.SamplingTime = ADC_SAMPLETIME_12CYCLES_5;
+	hadc.Init.ScanConvMode = ADC_SCAN_DIRECTION_FORWARD;
+	hadc.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+	hadc.Init.ContinuousConvMode = DISABLE;
+	hadc.Init.DiscontinuousConvMode = DISABLE;
+	hadc.Init.ExternalTrigConvEdge = ADC_EXTERNALTRIGCONVEDGE_RISING;
+	hadc.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T22_TRGO;
+	hadc.Init.DMAContinuousRequests = DISABLE;
+	hadc.Init.EOCSelection = ADC_EOC_SINGLE_CONV;
+	hadc.Init.Overrun = ADC_OVR_DATA_OVERWRITTEN;
+	hadc.Init.LowPowerAutoWait = DISABLE;
+	hadc.Init.LowPowerFrequencyMode = DISABLE;
+	hadc.Init.LowPowerAutoPowerOff = DISABLE;
+	if (HAL_ADC_Init(&hadc) != HAL_OK) {
+		Error_Handler();
+	}
+
+	sConfig.Channel = ADC_CHANNEL_4;
+	sConfig.Rank = ADC_RANK_CHANNEL_NUMBER;
+	if (HAL_ADC_ConfigChannel(&hadc, &sConfig) != HAL_OK) {
+		Error_Handler();
+	}
+
+	if (HAL_ADCEx_Calibration_Start(&hadc, ADC_SINGLE_ENDED) != HAL_OK) {
+		Error_Handler();
+	}
+}
+
+void HAL_ADC_MspInit(ADC_HandleTypeDef* adcHandle)
+{
+	GPIO_InitTypeDef GPIO_InitStruct = {0};
+
+	if (adcHandle->Instance == ADC1) {
+		__HAL_RCC_ADC1_CLK_ENABLE();
+
+		__HAL_RCC_GPIOA_CLK_ENABLE();
+		/**
+		 * ADC GPIO Configuration
+		 * PA4     ------> ADC_IN4
+		 */
+		GPIO_InitStruct.Pin = BEMF_Pin;
+		GPIO_InitStruct.Mode = GPIO_MODE_ANALOG;
+		GPIO_InitStruct.Pull = GPIO_NOPULL;
+		HAL_GPIO_Init(BEMF_GPIO_Port, &GPIO_InitStruct);
+
+		/* ADC DMA Init */
+		hdma_adc.Instance = DMA1_Channel1;
+		hdma_adc.Init.Request = DMA_REQUEST_0;
+		hdma_adc.Init.Direction = DMA_PERIPH_TO_MEMORY;
+		hdma_adc.Init.PeriphInc = DMA_PINC_DISABLE;
+		hdma_adc.Init.MemInc = DMA_MINC_ENABLE;
+		hdma_adc.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+		hdma_adc.Init.MemDataAlignment = DMA_MDATAALIGN_HALFWORD;
+		hdma_adc.Init.Mode = DMA_NORMAL;
+		hdma_adc.Init.Priority = DMA_PRIORITY_LOW;
+		if (HAL_DMA_Init(&hdma_adc) != HAL_OK) {
+			Error_Handler();
+		}
+
+		__HAL_LINKDMA(adcHandle, DMA_Handle, hdma_adc);
+	}
+}
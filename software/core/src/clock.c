@@ -0,0 +1,106 @@
+/*******************************************************************************
+ * @file    :   clock.c
+ * @brief   :   Operating points, HSI16 trimming and receiver timing
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "clock.h"
+#include "main.h"
+#include "decoder.h"
+#include "track_diag.h"
+
+/**
+ * The receiver windows and every other time base (the motor tick, the light
+ * PWM, the ACK) count HSI16, factory trimmed to 1 % at 25 °C
+ * but drifting by a few % more on a hot locomotive. The command station's
+ * crystal is the better reference: the halves of a 1 are sent at 58 us, so
+ * the period of a 1 averaged by track_diag is 116 us times our clock error.
+ *
+ * Trimming HSI16 corrects all the time bases at once, where moving the
+ * receiver windows would leave the others off. The average is sampled once
+ * per motor tick while packets arrive, and every CLOCK_TRIM_TICKS the trim
+ * moves one step if the error is over 3/4 of a step, so it settles without
+ * hunting. CLOCK_TRIM_RANGE bounds it: a station off its own tolerance
+ * (+-3 us a half) cannot drag the clock far from the factory calibration.
+ */
+
+#define CLOCK_PERIOD_NOMINAL	(116 << 4)	/* 1/16 us, as diag1.period */
+
+/* 1000000 / CLOCK_PERIOD_NOMINAL, ppm per 1/16 us */
+#define CLOCK_PPM_PER_UNIT	539
+
+#define CLOCK_MIN_SAMPLES	(CLOCK_TRIM_TICKS / 2)
+
+#define CLOCK_OP_ENTRY(name, hz, scale, latency, hsi, pll, sysclk, pwm) \
+	[CLOCK_##name] = { hz, scale, latency, hsi, pll, sysclk, pwm },
+
+static const struct clock_op clock_ops[CLOCK_OP_COUNT] = {
+	CLOCK_OPS(CLOCK_OP_ENTRY)
+};
+
+const struct clock_op *const clock_op = &clock_ops[CLOCK_OP];
+
+struct clock_stats clock_stats;
+
+static struct {
+	uint32_t sum;		/* diag1.period over the samples */
+	uint8_t samples;
+	uint8_t ticks;
+	uint32_t packets;	/* rx_stats.packets at the last tick */
+} trim1;
+
+uint32_t clock_hsi_trim(void)
+{
+	return RCC_HSICALIBRATION_DEFAULT + clock_stats.offset;
+}
+
+static void clock_trim_decide(void)
+{
+	/* diag1.period only follows valid 1s, so the sum stays small */
+	int32_t diff = (int32_t) trim1.sum -
+		       (int32_t) CLOCK_PERIOD_NOMINAL * trim1.samples;
+	int32_t ppm = diff * CLOCK_PPM_PER_UNIT / trim1.samples;
+	int8_t offset = clock_stats.offset;
+
+	clock_stats.error_ppm = ppm;
+
+	/* Fast: more ticks in a period, lower the frequency */
+	if (ppm > CLOCK_TRIM_STEP_PPM * 3 / 4 && offset > -CLOCK_TRIM_RANGE)
+		offset--;
+	else if (ppm < -CLOCK_TRIM_STEP_PPM * 3 / 4 &&
+		 offset < CLOCK_TRIM_RANGE)
+		offset++;
+
+	if (offset == clock_stats.offset)
+		return;
+
+	clock_stats.offset = offset;
+	clock_stats.trims++;
+	__HAL_RCC_HSI_CALIBRATIONVALUE_ADJUST(clock_hsi_trim());
+}
+
+void clock_trim_poll(void)
+{
+	uint32_t packets = rx_stats.packets;
+
+	/* Only while the signal is there: the average holds otherwise */
+	if (packets != trim1.packets) {
+		trim1.packets = packets;
+		trim1.sum += diag1.period;
+		trim1.samples++;
+	}
+
+	if (++trim1.ticks < CLOCK_TRIM_TICKS)
+		return;
+
+	if (trim1.samples >= CLOCK_MIN_SAMPLES)
+		clock_trim_decide();
+	else
+		clock_stats.skipped++;
+
+	trim1.sum = 0;
+	trim1.samples = 0;
+	trim1.ticks = 0;
+}
@@ -0,0 +1,184 @@
+/*******************************************************************************
+ * @file    :   bemf.c
+ * @brief   :   Back EMF measurement and load compensation of the motor
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "bemf.h"
+#include "motor.h"
+#include "speed_table.h"
+#include "cv.h"
+#include "adc.h"
+
+/**
+ * Every control period the motor tick turns the bridge off (both inputs low,
+ * outputs floating) and starts the ADC, triggered by the TIM22 update: the
+ * window lasts BEMF_SAMPLES PWM periods, the first BEMF_SETTLE conversions
+ * covering the decay of the motor current. The DMA completion averages the
+ * others, runs one PI update and turns the bridge back on.
+ *
+ * The setpoint is the back EMF expected at the speed_lut[] duty of the
+ * current step, scaled by CV#52; the controller adds a correction to that
+ * duty. Above the CV#10 step (128 steps scale) the correction is dropped.
+ *
+ * The update runs at the priority of the motor tick, below the DCC edges,
+ * at most once per motor tick and with a constant cost: no loop, no division.
+ */
+
+/* Integral term limit, one full scale duty */
+#define BEMF_INTEG_MAX		((int32_t) MOTOR_PWM_TOP << 10)
+
+static struct {
+	volatile bool busy;
+	uint8_t ticks;
+	uint8_t period;
+	uint8_t cutout;		/* last compensated internal step */
+	uint8_t kp, ki;
+	uint32_t set_mul;	/* setpoint = duty * set_mul >> 16 */
+	uint16_t ppm_mul;	/* share_ppm = cycles * ppm_mul >> 8 */
+	int32_t integ;
+	int16_t correction;
+} bemf1;
+
+static uint16_t samples[BEMF_SAMPLES];
+
+struct bemf_stats bemf_stats;
+
+void bemf_config(void)
+{
+	uint8_t cutout = read_cv(10);
+	uint8_t period = read_cv(CV_BEMF_PERIOD);
+	uint32_t full = (uint32_t) read_cv(CV_BEMF_FULL) << 4;
+
+	if (period == 0)
+		period = 1;
+
+	__disable_irq();
+	bemf1.kp = read_cv(CV_BEMF_KP);
+	bemf1.ki = read_cv(CV_BEMF_KI);
+	bemf1.cutout = cutout ? cutout - 1 : MOTOR_STEPS;
+	bemf1.period = period;
+	bemf1.set_mul = (full << 16) / MOTOR_PWM_TOP;
+	/* 10^6 / (cycles in a control period), 8 fractional bits */
+	bemf1.ppm_mul = (1000000ul << 8) /
+			((uint32_t) period * MOTOR_TICK_US * (SystemCoreClock / 1000000));
+	if (bemf1.kp == 0 && bemf1.ki == 0) {
+		bemf1.integ = 0;
+		bemf1.correction = 0;
+	}
+	__enable_irq();
+}
+
+bool bemf_busy(void)
+{
+	return bemf1.busy;
+}
+
+void bemf_cancel(void)
+{
+	HAL_ADC_Stop_DMA(&hadc);
+	bemf1.busy = false;
+	bemf_stats.timeouts++;
+}
+
+bool bemf_due(uint8_t step)
+{
+	if ((bemf1.kp == 0 && bemf1.ki == 0) || step == 0 ||
+	    step > bemf1.cutout) {
+		bemf1.integ = 0;
+		bemf1.correction = 0;
+		bemf1.ticks = 0;
+		return false;
+	}
+
+	if (++bemf1.ticks < bemf1.period)
+		return false;
+
+	bemf1.ticks = 0;
+	return true;
+}
+
+void bemf_start(void)
+{
+	bemf1.busy = true;
+	bemf_stats.windows++;
+
+	if (HAL_ADC_Start_DMA(&hadc, (uint32_t *) samples, BEMF_SAMPLES) !=
+	    HAL_OK)
+		bemf_cancel();
+}
+
+uint8_t bemf_adjust(uint8_t duty, uint8_t step)
+{
+	int16_t d;
+
+	if (bemf1.correction == 0 || step == 0 || step > bemf1.cutout)
+		return duty;
+
+	d = duty + bemf1.correction;
+	if (d < 0)
+		return 0;
+
+	return (d > MOTOR_PWM_TOP) ? MOTOR_PWM_TOP : d;
+}
+
+static void bemf_update(void)
+{
+	uint8_t ff = speed_lut[motor_step()];
+	int32_t set = (ff * bemf1.set_mul) >> 16;
+	int32_t err, corr;
+	uint16_t sum;
+
+	sum = samples[BEMF_SETTLE] + samples[BEMF_SETTLE + 1] +
+	      samples[BEMF_SETTLE + 2] + samples[BEMF_SETTLE + 3];
+	bemf_stats.value = sum >> 2;
+
+	err = set - bemf_stats.value;
+
+	bemf1.integ += err * bemf1.ki;
+	if (bemf1.integ > BEMF_INTEG_MAX)
+		bemf1.integ = BEMF_INTEG_MAX;
+	else if (bemf1.integ < -BEMF_INTEG_MAX)
+		bemf1.integ = -BEMF_INTEG_MAX;
+
+	corr = (err * bemf1.kp + bemf1.integ) >> 10;
+	if (corr > MOTOR_PWM_TOP)
+		corr = MOTOR_PWM_TOP;
+	else if (corr < -MOTOR_PWM_TOP)
+		corr = -MOTOR_PWM_TOP;
+
+	bemf1.correction = corr;
+	bemf_stats.correction = corr;
+}
+
+_Static_assert(BEMF_SAMPLES - BEMF_SETTLE == 4, "bemf_update() averages 4");
+
+/**
+ * End of a window, from the DMA interrupt.
+ */
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *adcHandle)
+{
+	uint32_t start = SysTick->VAL;
+	uint32_t cycles;
+
+	HAL_ADC_Stop_DMA(adcHandle);
+
+	bemf_update();
+
+	bemf1.busy = false;
+	motor_resume();
+
+	/* SysTick counts down and reloads every millisecond */
+	cycles = start - SysTick->VAL;
+	if ((int32_t) cycles < 0)
+		cycles += SysTick->LOAD + 1;
+
+	bemf_stats.cycles = cycles;
+	if (cycles > bemf_stats.cycles_max)
+		bemf_stats.cycles_max = cycles;
+	bemf_stats.share_ppm = (cycles * bemf1.ppm_mul) >> 8;
+	if (bemf_stats.share_ppm > bemf_stats.share_ppm_max)
+		bemf_stats.share_ppm_max = bemf_stats.share_ppm;
+}
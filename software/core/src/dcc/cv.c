@@ -14,8 +14,16 @@
  */
 
 #include "cv.h"
+#include "cv_table.h"
 #include "config.h"
-
+#include "decoder.h"
+#include "motor.h"
+#include "speed_table.h"
+#include "bemf.h"
+#include "function_map.h"
+#include "lights.h"
+#include "watchdog.h"
+#include "track_diag.h"
 
 #include <string.h>
 
@@ -61,6 +69,7 @@
  * 32 Index Low Byte				O U
  * 33-46 Output Location FL(f),FL(r),F1-F12	O U
  * 37-64 Manifacturer Unique
+ * 50-53 Back EMF controller (see bemf.h)
  * 65 Kick Start		O
  * 66 Forward Trim		O
  * 67-94 Speed Table		O
@@ -70,6 +79,9 @@
  * 106 User Identifier #2	O
  * 107-111 RESERVED FOR NMRA
  * 112-256 Manifacturer Unique	O
+ * 113-124 Light effects and brightness (see lights.h)
+ * 129-172 Receiver counters, read only	D (see decoder.h)
+ * 173-241 Pulse histogram and signal quality, read only	D (see track_diag.c)
  * 257-512 Indexed Area
  * 513-879 RESERVED FOR NMRA
  * 880-891 RESERVED FOR NMRA
@@ -82,78 +94,328 @@
 
 /**
  * Memory layout:
- * 0-127: CV#1 -> CV#128
+ *
+ * The data EEPROM is split in two pages of CV_PAGE_SIZE bytes used in turn,
+ * each one made of
+ * word 0:      header, CV_PAGE_MAGIC << 16 | generation
+ * words 1-32:  snapshot of CV#1 -> CV#128 taken when the page was started
+ * words 33-63: journal of the CVs written since then, one record per word,
+ *              sequence << 24 | (cv - 1) << 16 | value << 8 | zeros
+ *
+ * The active page is the valid one with the newest generation. At boot its
+ * snapshot is loaded and the journal replayed in order, up to the first slot
+ * not holding a valid record. The sequence of a record is the low byte of the
+ * generation of its page, so records left over from the previous use of the
+ * page are not replayed.
+ *
+ * A word cut off while being programmed only holds part of its bits: the
+ * erase clears bits of the old value, the program then sets bits of the new
+ * one. The check byte of a record counts the 0 bits of the other three, which
+ * such a cut can only raise while lowering the count itself, so a torn record
+ * is never taken for a valid one. A CRC does not give that: the kept check
+ * byte of a stale record can match a half written one.
+ *
+ * A CV write costs a single word program. When the journal is full the
+ * current CVs become the snapshot of the other page, whose header is written
+ * last to commit the switch: a power loss at any point leaves one of the two
+ * pages consistent.
  */
 
+#define CV_PAGE_MAGIC		0xc5a7u
+
 uint8_t CV[LAST_CV_NUM];
 
-static bool ram_only = false;
+/**
+ * CV descriptors, expanded from CV_TABLE at compile time and kept in flash:
+ * one bitmap per property, plus the default and the range of each implemented
+ * CV packed in ascending CV order. The position of a CV in the packed arrays
+ * is the number of implemented CVs before it: the rank of its word plus the
+ * bits set below it in the word.
+ */
+#define CV_MAP_WORDS		(LAST_CV_NUM / 32)
+
+#define CV_WORD_BIT(w, n)	(((n) - 1) / 32 == (w) ? 1ul << (((n) - 1) % 32) : 0)
+#define CV_MAP_BIT(w, n, d, lo, hi, f)	| CV_WORD_BIT(w, n)
+#define CV_RO_BIT(w, n, d, lo, hi, f)	| ((f) & CV_RO ? CV_WORD_BIT(w, n) : 0)
+#define CV_RECOMPUTE_BIT(w, n, d, lo, hi, f) \
+	| ((f) & CV_RECOMPUTE ? CV_WORD_BIT(w, n) : 0)
+#define CV_BEFORE(w, n, d, lo, hi, f)	+ (((n) - 1) / 32 < (w))
+#define CV_DEFAULT(a, n, d, lo, hi, f)	(d),
+#define CV_MIN(a, n, d, lo, hi, f)	(lo),
+#define CV_MAX(a, n, d, lo, hi, f)	(hi),
+
+#define CV_MAP(X)	{0 CV_TABLE(X, 0), 0 CV_TABLE(X, 1), \
+			 0 CV_TABLE(X, 2), 0 CV_TABLE(X, 3)}
+
+_Static_assert(CV_MAP_WORDS == 4, "CV_MAP() expands four words");
+_Static_assert(CV_RX_STATS_LAST < CV_DIAG_HIST, "dynamic CV ranges overlap");
+
+static const uint32_t cv_implemented[CV_MAP_WORDS] = CV_MAP(CV_MAP_BIT);
+static const uint32_t cv_readonly[CV_MAP_WORDS] = CV_MAP(CV_RO_BIT);
+static const uint32_t cv_derived[CV_MAP_WORDS] = CV_MAP(CV_RECOMPUTE_BIT);
+static const uint8_t cv_rank[CV_MAP_WORDS] = CV_MAP(CV_BEFORE);
+
+static const uint8_t cv_default[] = { CV_TABLE(CV_DEFAULT, 0) };
+static const uint8_t cv_min[] = { CV_TABLE(CV_MIN, 0) };
+static const uint8_t cv_max[] = { CV_TABLE(CV_MAX, 0) };
+
+static inline bool cv_flag(const uint32_t *map, uint16_t num)
+{
+	uint16_t idx = num - 1;
+
+	if (idx >= LAST_CV_NUM)
+		return false;
+
+	return (map[idx >> 5] >> (idx & 31)) & 1;
+}
+
+/* Position of an implemented CV in the packed arrays */
+static inline uint8_t cv_slot(uint16_t num)
+{
+	uint16_t idx = num - 1;
+	uint32_t below = cv_implemented[idx >> 5] & ((1ul << (idx & 31)) - 1);
+
+	return cv_rank[idx >> 5] + __builtin_popcount(below);
+}
+
+/**
+ * Rebuilds the state derived from a CV flagged CV_RECOMPUTE, or from all of
+ * them when num is 0.
+ */
+static void cv_recompute(uint16_t num)
+{
+	switch (num) {
+	case 0:
+	case 3:
+	case 4:
+	case 29:
+		motor_config();
+		break;
+	default:
+		break;
+	}
+
+	switch (num) {
+	case 0:
+	case 10:
+	case CV_BEMF_KP:
+	case CV_BEMF_KI:
+	case CV_BEMF_FULL:
+	case CV_BEMF_PERIOD:
+		bemf_config();
+		break;
+	default:
+		break;
+	}
+
+	decoder_address_update(num);
+	wd_update(num);
+	speed_table_update(num);
+	light_update(num);
+	fn_map_update(num);
+
+	/* Repeats of a cached packet may act differently now */
+	dcc_cache_flush();
+}
+
+static struct {
+	uint8_t page;		/* active page */
+	uint16_t gen;		/* generation of the active page */
+	uint8_t used;		/* journal slots in use */
+} store;
+
+/**
+ * Background commit of the CVs written at runtime.
+ *
+ * write_cv() only updates RAM and marks the CV as dirty; cv_commit_poll(),
+ * called from the main loop, then appends one journal record per call and
+ * never waits for the NVM to finish. Several writes to the same CV before its
+ * commit are coalesced by the dirty bitmap, and CVs whose stored value already
+ * matches RAM are skipped. Every program is read back once the NVM is done
+ * and reissued if it did not stick, up to CV_PROGRAM_RETRIES times: a worn
+ * word is then given up, so that it cannot hold back the other CVs or keep
+ * the decoder out of Stop. A journal slot given up ends the journal (the
+ * replay stops there), so its CV goes to the next snapshot instead.
+ *
+ * cv_dirty and the commit state are only touched from the main loop.
+ *
+ * Nothing is committed until CV_COMMIT_HOLDOFF_MS have passed since the last
+ * write, so that a burst of writes (e.g. programming on the main) reaches the
+ * EEPROM once, with its final values. A burst with more CVs than free journal
+ * slots goes straight to the compaction, whose snapshot holds all of them.
+ */
+enum commit_state {COMMIT_IDLE, COMMIT_COMPACT};
+
+#define NVM_ERROR_FLAGS		(FLASH_FLAG_WRPERR | FLASH_FLAG_PGAERR | \
+				 FLASH_FLAG_SIZERR | FLASH_FLAG_OPTVERR | \
+				 FLASH_FLAG_RDERR | FLASH_FLAG_FWWERR | \
+				 FLASH_FLAG_NOTZEROERR)
+
+static uint32_t cv_dirty[LAST_CV_NUM / 32];	/* one bit per CV */
+
+static struct {
+	enum commit_state state;
+	bool unlocked;
+	uint8_t next;			/* next snapshot word while compacting */
+	__IO uint32_t *addr;		/* last word programmed, to read back */
+	uint32_t val;
+	uint8_t retries;		/* of the word at addr */
+	uint32_t last_write;		/* HAL tick of the last write_cv() */
+	bool flush;			/* no hold-off, see cv_commit_flush() */
+} commit;
+
+struct cv_commit_stats cv_stats;
+
+static uint32_t *page_base(uint8_t page)
+{
+	return (uint32_t *) (CV_PAGE_ADDR(page));
+}
+
+static uint32_t *page_journal(uint8_t page)
+{
+	return page_base(page) + 1 + CV_SNAPSHOT_WORDS;
+}
+
+static bool header_valid(uint32_t header)
+{
+	return (header >> 16) == CV_PAGE_MAGIC;
+}
+
+/* 0 bits of sequence, index and value */
+static uint8_t record_zeros(uint32_t r)
+{
+	return 24 - __builtin_popcount(r >> 8);
+}
+
+static uint32_t record_make(uint16_t gen, uint8_t idx, uint8_t val)
+{
+	uint32_t r = (uint32_t) (gen & 0xff) << 24 | (uint32_t) idx << 16 |
+		     (uint32_t) val << 8;
+
+	return r | record_zeros(r);
+}
+
+static bool record_valid(uint32_t r, uint16_t gen)
+{
+	return (r >> 24) == (gen & 0xff) && ((r >> 16) & 0xff) < LAST_CV_NUM &&
+	       (r & 0xff) == record_zeros(r);
+}
+
+/**
+ * Value of a CV as it would be rebuilt from the data EEPROM.
+ */
+static uint8_t stored_value(uint8_t idx)
+{
+	const uint32_t *journal = page_journal(store.page);
+	uint8_t used;
+
+	/* As replayed: up to the first slot not holding a valid record */
+	for (used = 0; used < store.used; used++) {
+		if (!record_valid(journal[used], store.gen))
+			break;
+	}
+
+	for (uint8_t i = used; i > 0; i--) {
+		uint32_t r = journal[i - 1];
+
+		if (((r >> 16) & 0xff) == idx)
+			return r >> 8;
+	}
+
+	return ((uint8_t *) (page_base(store.page) + 1))[idx];
+}
 
 // TODO: check the result of every function call about data EEPROM
 
 uint8_t reset_cvs(void)
 {
-	ram_only = true;
+	uint8_t res;
 
 	memset(CV, 0x00, LAST_CV_NUM);
 
 	/* init_volatile_cvs(); */
 
-	/* Initializing variables with theire default values */
-	write_cv(1, DCC_ADDRESS);
-	write_cv(29, CV29);
+	for (uint16_t num = 1, slot = 0; num <= LAST_CV_NUM; num++)
+		if (cv_flag(cv_implemented, num))
+			CV[num - 1] = cv_default[slot++];
 
-	ram_only = false;
+	/* Start a fresh page holding the defaults */
+	res = save_all_cvs();
+	cv_recompute(0);
 
-	/* Erase CVs in data EEPROM */
-	return (save_all_cvs(1) == CV_OP_OK && save_all_cvs(2) == CV_OP_OK) ? CV_OP_OK : CV_OP_ERROR;
+	return res;
+}
+
+/**
+ * Read-only CVs take the value of this firmware, CVs out of range (e.g. left
+ * by an older layout) go back to their default.
+ */
+static void check_all_cvs(void)
+{
+	for (uint16_t num = 1, slot = 0; num <= LAST_CV_NUM; num++) {
+		uint8_t val = CV[num - 1];
+
+		if (!cv_flag(cv_implemented, num))
+			continue;
+
+		if (cv_flag(cv_readonly, num))
+			CV[num - 1] = cv_default[slot];
+		else if (val < cv_min[slot] || val > cv_max[slot])
+			write_cv(num, cv_default[slot]);
+		slot++;
+	}
 }
 
 uint8_t reload_all_cvs()
 {
-	bool bank1_ok, bank2_ok;
-	uint32_t *ok_bank, *error_bank;
-
-	bank1_ok = *((uint32_t *) CV_BANK1_OK_ADDR) == 0xaabbccdd;
-	bank2_ok = *((uint32_t *) CV_BANK2_OK_ADDR) == 0xaabbccdd;
-
-	if (bank1_ok) {
-		ok_bank = (uint32_t *) CV_BANK1_OK_ADDR;
-		if (bank2_ok)
-			error_bank = 0;
-		else
-			error_bank = (uint32_t *)CV_BANK2_OK_ADDR;
+	uint32_t h0 = page_base(0)[0];
+	uint32_t h1 = page_base(1)[0];
+	const uint32_t *journal;
+
+	if (header_valid(h0) && header_valid(h1)) {
+		/* Both valid: the newest generation wins */
+		store.page = ((int16_t) (h1 - h0) > 0) ? 1 : 0;
+	} else if (header_valid(h0)) {
+		store.page = 0;
+	} else if (header_valid(h1)) {
+		store.page = 1;
 	} else {
-		if (bank2_ok) {
-			error_bank = (uint32_t *) CV_BANK1_OK_ADDR;
-			ok_bank = (uint32_t *) CV_BANK2_OK_ADDR;
-		} else {
-			/* Both banks have problems */
-			ok_bank = 0;
-			error_bank = 0;
-			return reset_cvs();
-		}
+		/* No valid page */
+		return reset_cvs();
 	}
 
-	/* Only load into ram if at least a bank was valid */
-	if (ok_bank) {
-		/* Load CVs into RAM */
-		for (uint16_t i = 0; i < LAST_CV_NUM; i++)
-			CV[i] = *((uint8_t *) ok_bank + i);
-		if (error_bank) {
-			return save_all_cvs((error_bank == (uint32_t *) CV_BANK1_START_ADDR) ? 1 : 2);
-		}
+	store.gen = page_base(store.page)[0] & 0xffff;
+
+	/* Load the snapshot into RAM, then replay the journal */
+	memcpy(CV, page_base(store.page) + 1, LAST_CV_NUM);
+
+	journal = page_journal(store.page);
+	for (store.used = 0; store.used < CV_JOURNAL_SLOTS; store.used++) {
+		uint32_t r = journal[store.used];
+
+		if (!record_valid(r, store.gen))
+			break;
+
+		CV[(r >> 16) & 0xff] = r >> 8;
 	}
 
+	check_all_cvs();
+	cv_recompute(0);
+
 	return CV_OP_OK;
 }
 
 uint8_t read_cv(uint16_t num)
 {
-	if (is_cv_implemented(num)) {
+	if (cv_flag(cv_implemented, num)) {
 		/* CVs array is kept in sync with data EEPROM from startup,
 		   there is no need to read from EEPROM every time */
 		return CV[num - 1];
+	} else if (num >= CV_RX_STATS && num <= CV_RX_STATS_LAST) {
+		/* Dynamic, never stored */
+		return rx_stats_cv(num);
+	} else if (num >= CV_DIAG_HIST && num <= CV_DIAG_LAST) {
+		return diag_cv(num);
 	} else {
 		return 0;
 	}
@@ -161,125 +423,282 @@ uint8_t read_cv(uint16_t num)
 
 uint8_t write_cv(uint16_t num, uint8_t val)
 {
-	if (is_cv_implemented(num)) {
-		/* CV#7 and CV#8 are read only */
-		if (num == 7 || num == 8)
-			return 0;
+	uint8_t slot;
 
-		CV[num - 1] = val;
+	if (!cv_flag(cv_implemented, num) || cv_flag(cv_readonly, num))
+		return CV_OP_ERROR;
 
-		if (!ram_only) {
-			HAL_FLASHEx_DATAEEPROM_Unlock();
+	slot = cv_slot(num);
+	if (val < cv_min[slot] || val > cv_max[slot])
+		return CV_OP_ERROR;
 
-			uint32_t offset = (num - 1) & ~0x03;
+	if (CV[num - 1] == val) {
+		/* Already in EEPROM, or about to be */
+		cv_stats.skipped++;
+		return CV_OP_OK;
+	}
 
-			/* Invalidate bank1 */
-			HAL_FLASHEx_DATAEEPROM_Erase(CV_BANK1_OK_ADDR);
+	CV[num - 1] = val;
 
-			/* Erase word around that CV */
-			HAL_FLASHEx_DATAEEPROM_Erase(CV_BANK1_START_ADDR + offset);
+	uint8_t idx = num - 1;
+	uint32_t bit = 1ul << (idx & 31);
 
-			/* Rewrite whole word at the correct location */
-			HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, CV_BANK1_START_ADDR + offset, *((uint32_t *)(CV + offset)));
+	cv_stats.requests++;
+	if (cv_dirty[idx >> 5] & bit)
+		cv_stats.coalesced++;
 
-			/* Write validation word of bank1 */
-			HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, CV_BANK1_OK_ADDR, 0xaabbccdd);
+	cv_dirty[idx >> 5] |= bit;
+	commit.last_write = HAL_GetTick();
 
+	if (cv_flag(cv_derived, num))
+		cv_recompute(num);
 
-			/* Invalidate bank2 */
-			HAL_FLASHEx_DATAEEPROM_Erase(CV_BANK2_OK_ADDR);
+	return CV_OP_OK;
+}
 
-			/* Erase word around that CV */
-			HAL_FLASHEx_DATAEEPROM_Erase(CV_BANK2_START_ADDR + offset);
+/**
+ * Starts programming a word of the data EEPROM without waiting for the end of
+ * the operation, which is signalled by the BSY flag.
+ */
+static void eeprom_start_write(uint32_t *addr, uint32_t val)
+{
+	if (!commit.unlocked) {
+		HAL_FLASHEx_DATAEEPROM_Unlock();
+		commit.unlocked = true;
+	}
 
-			/* Rewrite whole word at the correct location */
-			HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, CV_BANK2_START_ADDR + offset, *((uint32_t *)(CV + offset)));
+	*(__IO uint32_t *) addr = val;
 
-			/* Write validation word of bank2 */
-			HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, CV_BANK2_OK_ADDR, 0xaabbccdd);
+	commit.addr = addr;
+	commit.val = val;
+	cv_stats.programs++;
+}
 
-			HAL_FLASHEx_DATAEEPROM_Lock();
-		}
+/**
+ * Gives up the word at commit.addr. The snapshot words and the header are
+ * left as they are, check_all_cvs() catches a value out of range at boot.
+ */
+static void word_failed(void)
+{
+	const uint32_t *journal = page_journal(store.page);
+	uint8_t idx = (commit.val >> 16) & 0xff;
 
-		return CV_OP_OK;
-	} else {
-		return CV_OP_ERROR;
-	}
+	cv_stats.errors++;
+
+	if (commit.addr < journal || commit.addr >= journal + CV_JOURNAL_SLOTS)
+		return;
+
+	/* Nothing after this slot is replayed: compact on the next commit */
+	store.used = CV_JOURNAL_SLOTS;
+	cv_dirty[idx >> 5] |= 1ul << (idx & 31);
 }
 
-uint8_t save_all_cvs(uint8_t bank)
+static bool any_dirty(void)
 {
-	uint32_t ok_addr, start_addr;
-
-	if (bank == 1) {
-		ok_addr = CV_BANK1_OK_ADDR;
-		start_addr = CV_BANK1_START_ADDR;
-	} else if (bank == 2) {
-		ok_addr = CV_BANK2_OK_ADDR;
-		start_addr = CV_BANK2_START_ADDR;
-	} else {
-		return 1;
+	for (uint8_t w = 0; w < LAST_CV_NUM / 32; w++) {
+		if (cv_dirty[w])
+			return true;
 	}
 
-	HAL_FLASHEx_DATAEEPROM_Unlock();
+	return false;
+}
+
+static uint8_t dirty_count(void)
+{
+	uint8_t n = 0;
+
+	for (uint8_t w = 0; w < LAST_CV_NUM / 32; w++)
+		n += __builtin_popcount(cv_dirty[w]);
+
+	return n;
+}
+
+/**
+ * Removes the lowest dirty CV from the bitmap.
+ * @returns: its index in CV[], or -1 if no CV is dirty.
+ */
+static int16_t take_dirty(void)
+{
+	for (uint8_t w = 0; w < LAST_CV_NUM / 32; w++) {
+		uint32_t bits = cv_dirty[w];
+		uint8_t i;
+
+		if (bits == 0)
+			continue;
 
-	HAL_FLASHEx_DATAEEPROM_Erase(ok_addr);
+		for (i = 0; !(bits & (1ul << i)); i++)
+			;
 
-	for (int i = 0; i < LAST_CV_NUM; i += 4) {
-		HAL_FLASHEx_DATAEEPROM_Erase(start_addr + i);
+		cv_dirty[w] &= ~(1ul << i);
 
-		HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, start_addr + i, *((uint32_t *)(CV + i)));
+		return w * 32 + i;
 	}
 
-	HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD, ok_addr, 0xaabbccdd);
+	return -1;
+}
 
-	HAL_FLASHEx_DATAEEPROM_Lock();
+void cv_commit_poll(void)
+{
+	const uint32_t *ram = (const uint32_t *) CV;
+	uint32_t *target;
+	int16_t idx;
+
+	if (__HAL_FLASH_GET_FLAG(FLASH_FLAG_BSY))
+		return;
+
+	if (commit.addr) {
+		if (*commit.addr != commit.val) {
+			__HAL_FLASH_CLEAR_FLAG(NVM_ERROR_FLAGS);
+			if (commit.retries < CV_PROGRAM_RETRIES) {
+				/* Did not stick: program it again */
+				commit.retries++;
+				cv_stats.retries++;
+				eeprom_start_write((uint32_t *) commit.addr,
+						   commit.val);
+				return;
+			}
+			word_failed();
+		}
+		commit.addr = NULL;
+		commit.retries = 0;
+	}
 
-	return CV_OP_OK;
+	switch (commit.state) {
+	case COMMIT_IDLE:
+		if (!any_dirty()) {
+			if (commit.unlocked) {
+				HAL_FLASHEx_DATAEEPROM_Lock();
+				commit.unlocked = false;
+			}
+			break;
+		}
+
+		if (!commit.flush &&
+		    HAL_GetTick() - commit.last_write < CV_COMMIT_HOLDOFF_MS)
+			break;
+
+		idx = take_dirty();
+		if (idx < 0)
+			break;
+
+		if (stored_value(idx) == CV[idx]) {
+			cv_stats.skipped++;
+			break;
+		}
+
+		if (store.used + 1 + dirty_count() <= CV_JOURNAL_SLOTS) {
+			eeprom_start_write(page_journal(store.page) + store.used,
+					   record_make(store.gen, idx, CV[idx]));
+			store.used++;
+			break;
+		}
+
+		/* Journal full: the new snapshot will hold these CVs as well */
+		cv_stats.compactions++;
+		commit.next = 0;
+		commit.state = COMMIT_COMPACT;
+		/* fall through */
+	case COMMIT_COMPACT:
+		target = page_base(store.page ^ 1);
+
+		/* Words already holding the right value are not rewritten */
+		while (commit.next < CV_SNAPSHOT_WORDS &&
+		       target[1 + commit.next] == ram[commit.next])
+			commit.next++;
+
+		if (commit.next < CV_SNAPSHOT_WORDS) {
+			eeprom_start_write(target + 1 + commit.next,
+					   ram[commit.next]);
+			commit.next++;
+			break;
+		}
+
+		/* Snapshot complete, the header commits the switch */
+		store.page ^= 1;
+		store.gen++;
+		store.used = 0;
+		eeprom_start_write(target,
+				   (uint32_t) CV_PAGE_MAGIC << 16 | store.gen);
+		commit.state = COMMIT_IDLE;
+		break;
+	}
 }
 
-/* void init_volatile_cvs(void)
+bool cv_commit_idle(void)
 {
+	if (any_dirty())
+		return false;
 
-} */
+	return commit.state == COMMIT_IDLE && commit.addr == NULL;
+}
 
-bool is_cv_implemented(uint16_t num)
+uint8_t cv_commit_flush(void)
 {
-	/* Primary Address */
-	if (num == 1)
-		return true;
+	uint16_t errors = cv_stats.errors;
 
-	/* Acceleration & Deceleration Rate */
-	if (num == 3 || num == 4)
-		return true;
+	commit.flush = true;
+	while (!cv_commit_idle())
+		cv_commit_poll();
+	commit.flush = false;
 
-	/* Manufacturer Version No. & Manufactured ID */
-	if (num == 7 || num == 8)
-		return true;
+	return cv_stats.errors == errors ? CV_OP_OK : CV_OP_ERROR;
+}
 
-	/* Alternate Mode Function Status F1-F8 & FL,F9-F12 */
-	if (num == 13 || num == 14)
-		return true;
+uint8_t save_all_cvs(void)
+{
+	const uint32_t *ram = (const uint32_t *) CV;
+	uint8_t page = store.page ^ 1;
+	uint16_t gen = store.gen + 1;
+	uint32_t addr = CV_PAGE_ADDR(page);
+	const uint32_t *target = page_base(page);
+	uint8_t res = CV_OP_OK;
+
+	/* Whatever the commit engine was doing is superseded */
+	while (__HAL_FLASH_GET_FLAG(FLASH_FLAG_BSY))
+		;
+	memset(cv_dirty, 0, sizeof(cv_dirty));
+	commit.state = COMMIT_IDLE;
+	commit.addr = NULL;
+	commit.retries = 0;
+	commit.unlocked = false;
 
-	/* Extended Address */
-	if (num == 17 || num == 18)
-		return true;
+	HAL_FLASHEx_DATAEEPROM_Unlock();
 
-	/* Decoder Automatic Stopping Configuration */
-	if (num == 27)
-		return true;
+	for (uint8_t i = 0; i < CV_SNAPSHOT_WORDS; i++) {
+		if (target[1 + i] == ram[i])
+			continue;
 
-	/* Output Locations 1-14 for Functions FL(f), FL(r), and F1-F12 */
-	if (num >= 33 && num <= 46)
-		return true;
+		if (HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD,
+						   addr + 4 * (1 + i),
+						   ram[i]) != HAL_OK)
+			res = CV_OP_ERROR;
+	}
 
-	/* Kick Start */
-	if (num == 65)
-		return true;
+	/* Commit the page only if the snapshot made it */
+	if (res == CV_OP_OK &&
+	    HAL_FLASHEx_DATAEEPROM_Program(FLASH_TYPEPROGRAMDATA_WORD,
+					   addr,
+					   (uint32_t) CV_PAGE_MAGIC << 16 | gen) == HAL_OK) {
+		store.page = page;
+		store.gen = gen;
+		store.used = 0;
+	} else {
+		res = CV_OP_ERROR;
+	}
 
-	/* Speed Table */
-	if (num >= 67 && num <= 94)
-		return true;
+	HAL_FLASHEx_DATAEEPROM_Lock();
 
-	return false;
+	return res;
+}
+
+/* void init_volatile_cvs(void)
+{
+
+} */
+
+bool is_cv_implemented(uint16_t num)
+{
+	return cv_flag(cv_implemented, num) ||
+	       (num >= CV_RX_STATS && num <= CV_RX_STATS_LAST) ||
+	       (num >= CV_DIAG_HIST && num <= CV_DIAG_LAST);
 }
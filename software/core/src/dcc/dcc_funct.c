@@ -8,6 +8,8 @@
 
 #include "dcc_funct.h"
 #include "cv.h"
+#include "motor.h"
+#include "function_map.h"
 #include "config.h"
 #include "main.h"
 
@@ -22,19 +24,16 @@ uint8_t dcc_dec_ctrl(uint8_t instr, uint8_t data, uint8_t data_c)
 	uint8_t sub_i;
 	uint8_t tmp;
 
-	sub_i = instr & 0x0fu;
+	/* 0000CCCD: the sub-instruction, D its argument */
+	sub_i = instr & 0x0eu;
 	switch (sub_i) {
 	case DCC_DC_RST:
-		if (data_c < 2) {
-			return DCC_ERROR;
-		}
-
-		if (data == 1) {
+		if (instr & 0x01u) {
 			/* Hard Reset */
 			write_cv(19, 0x00);
 			write_cv(29, CV29);
 			/* than call Digital Decoder Reset */
-		} else if (data == 0) {
+		} else {
 			/* Digital Decoder Reset */
 			/* TODO: implement */
 		}
@@ -53,10 +52,9 @@ uint8_t dcc_dec_ctrl(uint8_t instr, uint8_t data, uint8_t data_c)
 		/* TODO: implement */
 		break;
 	case DCC_DC_SAA:
-		/* Decoder Acknowledgment Request */
+		/* Set Advanced Addressing: CV#29 bit 5 takes D */
 		tmp = read_cv(29);
-		write_cv(29, tmp | 0x20);
-		/* TODO: implement */
+		write_cv(29, (instr & 0x01u) ? tmp | 0x20u : tmp & ~0x20u);
 		break;
 	case DCC_DC_DAR:
 		/* Decoder Acknowledgment Request */
@@ -69,7 +67,6 @@ uint8_t dcc_dec_ctrl(uint8_t instr, uint8_t data, uint8_t data_c)
 	return DCC_OK;
 }
 
-/* TODO: implement */
 uint8_t dcc_cons_ctrl(uint8_t instr, uint8_t data, uint8_t data_c)
 {
 	uint8_t sub_i;
@@ -80,21 +77,23 @@ uint8_t dcc_cons_ctrl(uint8_t instr, uint8_t data, uint8_t data_c)
 
 	sub_i = instr & 0x0fu;
 
-	switch (sub_i) {
-	case DCC_CC_FWD:
-		/* Consist direction: Normal */
-		break;
-	case DCC_CC_BWD:
-		/* Consist direction: Opposite */
-		break;
-	default:
+	if (sub_i != DCC_CC_FWD && sub_i != DCC_CC_BWD) {
+		return DCC_ERROR;
+	}
+
+	if (data & 0x80u) {
 		return DCC_ERROR;
 	}
 
 	if (data == 0) {
 		/* Consist deactivated */
+		write_cv(19, 0x00);
+	} else if (sub_i == DCC_CC_BWD) {
+		/* Consist activated with address, direction: Opposite */
+		write_cv(19, data | 0x80u);
 	} else {
-		/* Consist activated with address */
+		/* Consist activated with address, direction: Normal */
+		write_cv(19, data);
 	}
 
 	return DCC_OK;
@@ -132,17 +131,50 @@ uint8_t dcc_cv_acc_s(uint8_t instr, const uint8_t * buffer, uint8_t data_c)
 	return DCC_OK;
 }
 
-/* TODO: implement */
+/**
+ * Last long form CV access instruction: a write is only executed when the
+ * same instruction comes twice in a row, and only once however many times it
+ * is repeated after that. Any other packet to this decoder ends the run, see
+ * dcc_cv_acc_end().
+ */
+static struct {
+	uint8_t instr, cv, data;
+	bool done;
+} pom;
+
+struct pom_stats pom_stats;
+
+void dcc_cv_acc_end(void)
+{
+	/* Never a long form instruction, the next one cannot repeat it */
+	pom.instr = 0;
+	pom.done = false;
+}
+
 uint8_t dcc_cv_acc_l(uint8_t instr, const uint8_t * buffer, uint8_t data_c)
 {
-	uint8_t i_type;
+	uint8_t i_type, data, val, bit;
 	uint16_t cv;
+	bool repeat;
 
 	if (data_c < 3) {
 		return DCC_ERROR;
 	}
 
-	cv = ((instr & 0x3u) << 8u | *buffer++) + 1;
+	cv = ((instr & 0x3u) << 8u | buffer[0]) + 1;
+	data = buffer[1];
+
+	repeat = pom.instr == instr && pom.cv == buffer[0] && pom.data == data;
+	if (!repeat) {
+		pom.instr = instr;
+		pom.cv = buffer[0];
+		pom.data = data;
+		pom.done = false;
+	}
+
+	if (pom.done) {
+		return DCC_OK;
+	}
 
 	i_type = (instr & 0x0Cu) >> 2u;
 	switch (i_type) {
@@ -150,22 +182,49 @@ uint8_t dcc_cv_acc_l(uint8_t instr, const uint8_t * buffer, uint8_t data_c)
 		/* Reserved for future use */
 		break;
 	case 0x1:
-		/* Verify byte CV# */
+		/* Verify byte CV#, no way to answer without RailCom */
+		pom.done = true;
+		pom_stats.verifies++;
+		if (read_cv(cv) != data)
+			pom_stats.mismatches++;
 		break;
 	case 0x3:
 		/* Write byte CV# */
+		if (!repeat)
+			break;
+		pom.done = true;
+		if (write_cv(cv, data) == CV_OP_OK)
+			pom_stats.writes++;
+		else
+			pom_stats.rejected++;
 		break;
 	case 0x2:
-		/* Bit manipulation */
-		if (*buffer & 0x10u) {
-			/* CV write bit */
-			// bit = *buffer & 0x07u;
-			// val = *buffer & 0x08u;
-		} else {
+		/* Bit manipulation, data is 111KDBBB */
+		if ((data & 0xe0u) != 0xe0u) {
+			return DCC_ERROR;
+		}
+
+		val = read_cv(cv);
+		bit = 1u << (data & 0x07u);
+
+		if (!(data & 0x10u)) {
 			/* CV verify bit */
-			// bit = *buffer & 0x07u;
-			// val = *buffer & 0x08u;
+			pom.done = true;
+			pom_stats.verifies++;
+			if (!(val & bit) != !(data & 0x08u))
+				pom_stats.mismatches++;
+			break;
 		}
+
+		/* CV write bit */
+		if (!repeat)
+			break;
+		pom.done = true;
+		val = (data & 0x08u) ? val | bit : val & ~bit;
+		if (write_cv(cv, val) == CV_OP_OK)
+			pom_stats.writes++;
+		else
+			pom_stats.rejected++;
 		break;
 	default:
 		break;
@@ -189,7 +248,6 @@ uint8_t dcc_ana_fun_g(const uint8_t * buffer, uint8_t data_c)
 	return DCC_OK;
 }
 
-/* TODO: implement */
 uint8_t dcc_128_speed(const uint8_t * buffer, uint8_t data_c)
 {
 	uint8_t dir, speed;
@@ -203,6 +261,18 @@ uint8_t dcc_128_speed(const uint8_t * buffer, uint8_t data_c)
 	dir = (*buffer & 0x80u) >> 7u;
 	speed = *buffer & 0x7fu;
 
+	fn_direction(!dir);
+
+	if (speed == 0x00) {
+		/* Stop */
+		motor_set(0, !dir);
+	} else if (speed == 0x01) {
+		/* Emergency stop! */
+		motor_estop();
+	} else {
+		motor_set(speed - 1, !dir);
+	}
+
 	return DCC_OK;
 }
 
@@ -282,90 +352,57 @@ uint8_t dcc_bin_state_l(const uint8_t * buffer, uint8_t data_c)
 	return DCC_OK;
 }
 
-/* TODO: implement */
-void dcc_fun_g1(uint8_t instr)
+/**
+ * FL bit of an address mode for the direction of travel: bit 4 forward, bit 5
+ * reverse, returned as bit 4 as in the instructions.
+ */
+static uint8_t fl_mask(uint8_t mask, bool reverse)
 {
-	uint8_t fun;
+	return (mask & 0x0fu) | ((mask & (reverse ? 0x20u : 0x10u)) ? 0x10u : 0);
+}
 
+void dcc_fun_g1(uint8_t instr, uint8_t mask)
+{
 	/* Function Group 1 Instruction */
-
-	fun = instr & 0x1fu;
-
-	/* F1 */
-	if (fun & 0x01) {
-		HAL_GPIO_WritePin(C_GPIOA_GPIO_Port, C_GPIOA_Pin, GPIO_PIN_SET);
-	} else {
-		HAL_GPIO_WritePin(C_GPIOA_GPIO_Port, C_GPIOA_Pin,
-				  GPIO_PIN_RESET);
-	}
-
-	/* F2 */
-	if (fun & 0x02) {
-		HAL_GPIO_WritePin(C_GPIOB_GPIO_Port, C_GPIOB_Pin, GPIO_PIN_SET);
-	} else {
-		HAL_GPIO_WritePin(C_GPIOB_GPIO_Port, C_GPIOB_Pin,
-				  GPIO_PIN_RESET);
-	}
-
-	/* F3 */
-	if (fun & 0x04) {
-		HAL_GPIO_WritePin(C_AUX1_GPIO_Port, C_AUX1_Pin, GPIO_PIN_SET);
-	} else {
-		HAL_GPIO_WritePin(C_AUX1_GPIO_Port, C_AUX1_Pin, GPIO_PIN_RESET);
-	}
-
-	/* F4 */
-	if (fun & 0x08) {
-		HAL_GPIO_WritePin(C_AUX2_GPIO_Port, C_AUX2_Pin, GPIO_PIN_SET);
-	} else {
-		HAL_GPIO_WritePin(C_AUX2_GPIO_Port, C_AUX2_Pin, GPIO_PIN_RESET);
-	}
-
-	/* FL */
-	/*if (read_cv(29) & 0x02) {
-	   if (fun & 0x10) {
-
-	   } else {
-
-	   }
-	   } */
+	fn_group1(instr & 0x1fu, fl_mask(mask, fn_reverse()));
 }
 
-/* TODO: implement */
-void dcc_fun_g2(uint8_t instr)
+void dcc_fun_g2(uint8_t instr, uint8_t mask)
 {
-	uint8_t fun;
-
-	/* Function Group 2 Instruction */
-
-	fun = instr & 0x1fu;
-
-	if (fun & 0x10u) {
-		/* F12 - F9 */
-	} else {
-		/* F8 - F5 */
-	}
+	/* Function Group 2 Instruction, F5 - F8 or F9 - F12 */
+	fn_group2(instr & 0x1fu, mask);
 }
 
-/* TODO: implement */
 /**
  * If Bit 1 of CV#29 is set, bit 4 is used as an intermediate speed step; else
  * it is used to control FL (front headlight)
  */
-void dcc_vel_dir(uint8_t instr)
+void dcc_vel_dir(uint8_t instr, uint8_t mask)
 {
-	uint8_t dir, speed;
+	uint8_t dir, speed, step;
 
 	/* Speed and Direction Instruction */
 	dir = instr & 0x20u;
 	speed = instr & 0x1fu;
 
+	fn_direction(!dir);
+	if (!(read_cv(29) & 0x02u) && (fl_mask(mask, !dir) & 0x10u))
+		fn_light(speed & 0x10u);
+
 	if ((speed & 0x0f) == 0x00) {
 		/* Stop */
+		motor_set(0, !dir);
 	} else if ((speed & 0x0f) == 0x01) {
 		/* Emergency stop! */
+		motor_estop();
+	} else if (read_cv(29) & 0x02u) {
+		/* 28 speed steps, bit 4 being the least significant bit */
+		step = (((speed & 0x0fu) << 1) | (speed >> 4)) - 3;
+		motor_set((step * 9) >> 1, !dir);
 	} else {
-
+		/* 14 speed steps, bit 4 controls FL */
+		step = (speed & 0x0fu) - 1;
+		motor_set(step * 9, !dir);
 	}
 }
 
@@ -8,10 +8,16 @@
 
 #include "decoder.h"
 #include "dcc_funct.h"
+#include "edge_capture.h"
+#include "service_mode.h"
+#include "watchdog.h"
+#include "track_diag.h"
+#include "clock.h"
+#include "cv.h"
 #include "config.h"
 #include "main.h"
 
-#include <stdlib.h>
+#include <stddef.h>
 
 const uint32_t ONE_MIN = 52;		/* 52 µs */
 const uint32_t ONE_MAX = 64;		/* 64 µs */
@@ -22,134 +28,421 @@ const uint32_t ZERO_MAX = 10000;	/* 10000 µs  */
 const uint32_t ZERO_COMPL = 12000;	/* 12000 µs  */
 
 struct decoder dec1;
+struct packet_queue pq1;
+
+/* Until the CVs are loaded: the default address, no consist */
+struct dcc_addr_set addr1 = {
+	.own = DCC_ADDRESS,
+	.consist = DCC_ADDR_NONE,
+	.mode[DCC_ADDR_OWN] = {0x3fu, 0x0fu, 0x0fu, false},
+};
+
+uint8_t pulse_lut[PULSE_LUT_LEN];
+
+static struct dcc_cache_entry dcc_cache[DCC_CACHE_SLOTS];
+struct dcc_cache_stats dcc_cache_stats;
+
+struct rx_stats rx_stats;
+
+/**
+ * What a pulse of a given class does in each state. The unused state codes
+ * (phase 3 and half 3) reset the receiver.
+ */
+enum rx_action {
+	RX_RESET,
+	RX_HALF_ONE,		/* first half of a 1 */
+	RX_HALF_ZERO,		/* first half of a 0 */
+	RX_PRE_ONE,		/* preamble bit */
+	RX_PRE_ZERO,		/* end of the preamble */
+	RX_DATA_ONE,		/* data bits */
+	RX_DATA_ZERO,
+	RX_SEP_ONE,		/* end of the packet */
+	RX_SEP_ZERO		/* end of a byte */
+};
+
+static const uint8_t rx_action[16][PULSE_CLASSES] RAMDATA = {
+	[RX_PRE]		= {RX_HALF_ONE, RX_HALF_ZERO, RX_RESET},
+	[RX_PRE | RX_H1]	= {RX_PRE_ONE, RX_HALF_ZERO, RX_RESET},
+	[RX_PRE | RX_H0]	= {RX_HALF_ONE, RX_PRE_ZERO, RX_RESET},
+	[RX_DATA]		= {RX_HALF_ONE, RX_HALF_ZERO, RX_RESET},
+	[RX_DATA | RX_H1]	= {RX_DATA_ONE, RX_HALF_ZERO, RX_RESET},
+	[RX_DATA | RX_H0]	= {RX_HALF_ONE, RX_DATA_ZERO, RX_RESET},
+	[RX_SEP]		= {RX_HALF_ONE, RX_HALF_ZERO, RX_RESET},
+	[RX_SEP | RX_H1]	= {RX_SEP_ONE, RX_HALF_ZERO, RX_RESET},
+	[RX_SEP | RX_H0]	= {RX_HALF_ONE, RX_SEP_ZERO, RX_RESET},
+};
+
+/**
+ * Classifies the address once byte_n bytes are stored, with the same rules as
+ * decode(): 0x00 is broadcast, 0xff idle, a first byte 11xxxxxx is followed
+ * by a second address byte. 10xxxxxx are accessory addresses, never ours. In
+ * service mode a first byte 0111xxxx starts an instruction for any decoder on
+ * the programming track.
+ */
+static inline uint8_t rx_address(const struct decoder *dec)
+{
+	uint8_t a0 = dec->bytes[0];
+	uint16_t key;
+
+	if (dec->byte_n == 1) {
+		if (dec->service && (a0 & 0xf0u) == 0x70u)
+			return RX_ADDR_OURS;
+		if (a0 == DCC_BROADCAST)
+			return RX_ADDR_BROADCAST;
+		if (a0 == DCC_IDLEADDR)
+			return RX_ADDR_IDLE;
+		if ((a0 & 0xc0u) == 0xc0u)
+			return RX_ADDR_PENDING;
+		key = a0;
+	} else {
+		key = DCC_ADDR_LONG | ((a0 & 0x3fu) << 8u) | dec->bytes[1];
+	}
 
-void interrupt_funct(uint16_t T)
+	return dcc_addr_match(key) ? RX_ADDR_OURS : RX_ADDR_FOREIGN;
+}
+
+void decoder_address_update(uint16_t num)
 {
-	if (ONE_MIN < T && T < ONE_MAX) { /* pulse duration is within ONE timings */
-		if (dec1.half1 == true)	{
-			/* it's second part of a 1-bit */
-
-			if (abs(T - dec1.T_prev) <= ONE_DELTA) {
-				/* difference between first and second part is within limits */
-
-				if (dec1.has_preamble == true) {
-					/* already have a preamble, it's a bit */
-
-					if (dec1.N == 8) {
-						/* end of packet bit */
-						dec1.bytes[dec1.byte_n] = dec1.actual_byte;
-						dec1.byte_n++;
-
-						decoder_end(&dec1);
-						return;
-					} else {
-						/* normal data bit */
-						uint8_t mask = 1 << (7 - dec1.N);
-
-						dec1.actual_byte |= mask;
-						dec1.N++;
-						dec1.half1 = false;
-						return;
-					}
-				} else {
-					/* has no preamble yet, it's a preamble bit */
-					dec1.N++;
-					dec1.half1 = false;
-					return;
-				}
-			} else {
-				/* difference between two parts outside limits */
-				decoder_reset(&dec1);
-				return;
-			}
+	struct dcc_addr_mode *m = &addr1.mode[DCC_ADDR_CONSIST];
+	uint8_t consist;
+
+	switch (num) {
+	case 0:
+	case 1:
+	case 17:
+	case 18:
+	case 19:
+	case 21:
+	case 22:
+	case 29:
+		break;
+	default:
+		return;
+	}
+
+	/* CV#29 bit 5: the long address replaces the primary one */
+	if (read_cv(29) & 0x20u)
+		addr1.own = DCC_ADDR_LONG | ((read_cv(17) & 0x3fu) << 8u) |
+			    read_cv(18);
+	else
+		addr1.own = read_cv(1);
+
+	/* CV#19: consist address, bit 7 for the opposite direction */
+	consist = read_cv(19);
+	addr1.consist = (consist & 0x7fu) ? consist & 0x7fu : DCC_ADDR_NONE;
+	m->reverse = consist & 0x80u;
+
+	/**
+	 * CV#21 bits 0-7 enable F1-F8 on the consist address, CV#22 bits 0-1
+	 * FL forward and reverse, and bits 2-5 F9-F12.
+	 */
+	m->fg1 = (read_cv(21) & 0x0fu) | (read_cv(22) & 0x03u) << 4;
+	m->f5_8 = read_cv(21) >> 4;
+	m->f9_12 = (read_cv(22) >> 2) & 0x0fu;
+}
+
+void decoder_init(void)
+{
+	uint8_t cls;
+
+	diag_init();
+
+	/* Assumes ONE_MAX <= ZERO_MIN < PULSE_LUT_LEN <= ZERO_MAX */
+	for (uint16_t T = 0; T < PULSE_LUT_LEN; T++) {
+		if (ONE_MIN < T && T < ONE_MAX)
+			cls = PULSE_ONE;
+		else if (ZERO_MIN < T && T < ZERO_MAX)
+			cls = PULSE_ZERO;
+		else
+			cls = PULSE_INVALID;
+
+		pulse_lut[T] = cls | diag_bin(T) << PULSE_BIN_SHIFT;
+	}
+
+	decoder_reset(&dec1);
+}
+
+/**
+ * Table-driven bit receiver: a half-bit is classified by pulse_lut[], and the
+ * pair (state, class) selects the action in rx_action[]. Only the second half
+ * of a bit checks its timing against the first one: the two halves of a 1 may
+ * differ by at most ONE_DELTA, a whole 0 may last at most ZERO_COMPL.
+ *
+ * Packets that are not for us are dropped at the end of their address, and
+ * the receiver goes back to waiting for a preamble: on a busy layout most of
+ * the traffic never reaches bytes[] past the address, the packet queue or the
+ * checksum in decode().
+ *
+ * Worst case on the Cortex-M0+, hand-counted at zero wait states (add about a
+ * third with FLASH_LATENCY_1; build/decoder.lst has the actual sequence):
+ * classification ~10 cycles, table dispatch ~15, longest action (end of
+ * packet) ~20, plus decoder_end(): ~35 cycles and 4 per byte copied to the
+ * packet queue. Every other edge stays under ~50 cycles and takes at most four
+ * conditional branches, where the if/else cascade it replaces took up to
+ * eight. The pulse histogram adds ~10 cycles to every edge and the signal
+ * averages ~15 to the second half of a 1, see track_diag.h.
+ */
+RAMFUNC void interrupt_funct(uint16_t T)
+{
+	struct decoder *dec = &dec1;
+	uint8_t cls = pulse_class(T);
+
+	diag_pulse(T, cls);
+
+	switch (rx_action[dec->state][cls]) {
+	case RX_HALF_ONE:
+		dec->T_prev = T;
+		dec->state = (dec->state & RX_PHASE) | RX_H1;
+		return;
+	case RX_HALF_ZERO:
+		dec->T_prev = T;
+		dec->state = (dec->state & RX_PHASE) | RX_H0;
+		return;
+	case RX_PRE_ONE:
+		if ((uint16_t) (T - dec->T_prev + ONE_DELTA) > 2 * ONE_DELTA) {
+			rx_stats.symmetry++;
+			break;
 		}
-		else	/* first part of the bit */
-		{
-			dec1.half1 = true;
-			dec1.half0 = false;
-			dec1.T_prev = T;
-			return;
+		diag_one(T, dec->T_prev);
+		if (dec->N < PREAMBLE_MIN)
+			dec->N++;
+		dec->state = RX_PRE;
+		return;
+	case RX_PRE_ZERO:
+		if (T + dec->T_prev > ZERO_COMPL) {
+			rx_stats.framing++;
+			break;
 		}
-	} else if (ZERO_MIN < T && T < ZERO_MAX) {
-		/* pulse duration is within ZERO timings */
-
-		if (dec1.half0 == true) {
-			/* it's second part of a 0-bit */
-
-			if (T + dec1.T_prev > ZERO_COMPL) {
-				/* Total bit length outside limits*/
-				decoder_reset(&dec1);
-				return;
-			} else {
-				if (dec1.has_preamble) {
-					/* already have a preamble, it's a bit */
-
-					if (dec1.N == 8) {
-						/* bit that marks the end of the byte */
-						dec1.bytes[dec1.byte_n] = dec1.actual_byte;
-						dec1.byte_n++;
-						dec1.N = 0;
-
-						dec1.half0 = false;
-						dec1.actual_byte = 0;
-						return;
-					} else	{
-						/* normal data bit */
-						dec1.N++;
-						dec1.half0 = false;
-						return;
-					}
-				} else {
-					/* No preamble yet, it's the end of a potential preamble */
-
-					if (dec1.N >= 10) {
-						/* Valid preamble */
-						dec1.has_preamble = true;
-						dec1.half0 = false;
-						dec1.N = 0;
-						return;
-					} else {
-						/* Invalid preamble */
-						decoder_reset(&dec1);
-						return;
-					}
-				}
+		if (dec->N < PREAMBLE_MIN) {
+			/* Hunting for a preamble after an error is no failure */
+			if (dec->synced)
+				rx_stats.preamble++;
+			break;
+		}
+		rx_stats.packets++;
+		dec->N = 0;
+		dec->state = RX_DATA;
+		return;
+	case RX_DATA_ONE:
+		if ((uint16_t) (T - dec->T_prev + ONE_DELTA) > 2 * ONE_DELTA) {
+			rx_stats.symmetry++;
+			break;
+		}
+		diag_one(T, dec->T_prev);
+		dec->actual_byte = (dec->actual_byte << 1) | 1;
+		dec->state = (++dec->N == 8) ? RX_SEP : RX_DATA;
+		return;
+	case RX_DATA_ZERO:
+		if (T + dec->T_prev > ZERO_COMPL) {
+			rx_stats.framing++;
+			break;
+		}
+		dec->actual_byte <<= 1;
+		dec->state = (++dec->N == 8) ? RX_SEP : RX_DATA;
+		return;
+	case RX_SEP_ONE:
+		if ((uint16_t) (T - dec->T_prev + ONE_DELTA) > 2 * ONE_DELTA) {
+			rx_stats.symmetry++;
+			break;
+		}
+		diag_one(T, dec->T_prev);
+		dec->bytes[dec->byte_n++] = dec->actual_byte;
+		decoder_end(dec);
+		return;
+	case RX_SEP_ZERO:
+		/* Keep room for the last byte, stored by RX_SEP_ONE */
+		if (T + dec->T_prev > ZERO_COMPL ||
+		    dec->byte_n >= DCC_PACKET_MAX - 1) {
+			rx_stats.framing++;
+			break;
+		}
+		dec->bytes[dec->byte_n++] = dec->actual_byte;
+		if (dec->addr == RX_ADDR_PENDING) {
+			dec->addr = rx_address(dec);
+			if (dec->addr == RX_ADDR_FOREIGN) {
+				rx_stats.foreign++;
+				break;
+			}
+			if (dec->addr == RX_ADDR_IDLE) {
+				rx_stats.idle++;
+				break;
 			}
-		} else {
-			/* first part of the bit */
-			dec1.half0 = true;
-			dec1.half1 = false;
-			dec1.T_prev = T;
-			return;
 		}
-	} else {
-		/* pulse duration marks neither a zero or a one */
-		decoder_reset(&dec1);
+		dec->N = 0;
+		dec->state = RX_DATA;
+		return;
+	default:
+		/* Pulse out of the windows */
+		rx_stats.framing++;
+		break;
 	}
 
-	return;
+	/* Pulse not valid in this state, or packet dropped */
+	decoder_reset(dec);
 }
 
-void decoder_reset(struct decoder *dec)
+RAMFUNC void decoder_reset(struct decoder *dec)
 {
-	dec->half1 = false;
-	dec->half0 = false;
-	dec->has_preamble = false;
+	dec->state = RX_PRE;
 	dec->T_prev = 0;
 	dec->N = 0;
 	dec->byte_n = 0;
+	dec->actual_byte = 0;
+	dec->addr = RX_ADDR_PENDING;
+	dec->synced = false;
 }
 
-void decoder_end(struct decoder *dec)
+RAMFUNC void decoder_end(struct decoder *dec)
 {
-	decode(dec->bytes, dec->byte_n, 1);
+	/**
+	 * On overflow the packet is dropped and counted in pq1.overflows. The
+	 * edge being received is the last one of the packet.
+	 */
+	pq_push(&pq1, dec->bytes, dec->byte_n, er1.prev);
 
 	decoder_reset(dec);
+	dec->synced = true;
+}
+
+void decoder_poll(void)
+{
+	const struct dcc_packet *p;
+
+	while ((p = pq_peek(&pq1)) != NULL) {
+		uint32_t start = SysTick->VAL;
+
+		if (!svc_packet(p)) {
+			switch (decode(p->bytes, p->len, 1)) {
+			case DCC_OK:
+				rx_stats.accepted++;
+				break;
+			case DCC_IGNORE:
+				rx_stats.ignored++;
+				break;
+			case DCC_ERROR:
+				rx_stats.checksum++;
+				break;
+			default:
+				/* Idle packets are dropped by the receiver */
+				break;
+			}
+		}
+		pq_pop(&pq1);
+		clock_packet(clock_cycles(start));
+	}
+}
+
+uint8_t rx_stats_cv(uint16_t num)
+{
+	uint16_t idx = num - CV_RX_STATS;
+	uint32_t val;
+
+	if (idx / 4 < RX_STATS_COUNTERS - 1)
+		val = ((const uint32_t *) &rx_stats)[idx / 4];
+	else
+		val = pq1.overflows;
+
+	return val >> (8 * (3 - (idx & 3)));
+}
+
+void dcc_cache_flush(void)
+{
+	for (uint8_t i = 0; i < DCC_CACHE_SLOTS; i++)
+		dcc_cache[i].len = 0;
+}
+
+/**
+ * Cache slot of an instruction, buffer pointing at the instruction byte.
+ */
+static uint8_t dcc_cache_slot(const uint8_t *buffer, uint8_t data_c)
+{
+	uint8_t instr = *buffer;
+
+	switch (instr & 0xe0u) {
+	case DCC_DCCI:
+		return DCC_CACHE_BYPASS;
+	case DCC_SDIR:
+	case DCC_SDIF:
+		/* U0000 is stop, U0001 emergency stop */
+		if ((instr & 0x0fu) <= 0x01u)
+			return DCC_CACHE_BYPASS;
+		return DCC_CACHE_SPEED;
+	case DCC_AOI:
+		if ((instr & 0x1fu) != 0x1f || data_c < 2)
+			return DCC_CACHE_NONE;
+		if ((buffer[1] & 0x7fu) <= 0x01u)
+			return DCC_CACHE_BYPASS;
+		/* Same slot as 14/28 steps: either format replaces the other */
+		return DCC_CACHE_SPEED;
+	case DCC_FG1I:
+		return DCC_CACHE_FG1;
+	case DCC_FG2I:
+		return (instr & 0x10u) ? DCC_CACHE_FG2_LO : DCC_CACHE_FG2_HI;
+	case DCC_FE:
+		if ((instr & 0x1fu) == DCC_FE_F1320)
+			return DCC_CACHE_F13_20;
+		if ((instr & 0x1fu) == DCC_FE_F2128)
+			return DCC_CACHE_F21_28;
+		return DCC_CACHE_NONE;
+	default:
+		return DCC_CACHE_NONE;
+	}
+}
+
+static bool dcc_cache_hit(uint8_t slot, const uint8_t *buffer, uint8_t data_c,
+			  uint8_t match)
+{
+	const struct dcc_cache_entry *e = &dcc_cache[slot];
+
+	if (e->len != data_c || e->match != match)
+		return false;
+
+	for (uint8_t i = 0; i < data_c; i++)
+		if (e->payload[i] != buffer[i])
+			return false;
+
+	return true;
+}
+
+static void dcc_cache_store(uint8_t slot, const uint8_t *buffer,
+			    uint8_t data_c, uint8_t match)
+{
+	struct dcc_cache_entry *e = &dcc_cache[slot];
+
+	if (data_c > DCC_CACHE_PAYLOAD) {
+		e->len = 0;
+		return;
+	}
+
+	for (uint8_t i = 0; i < data_c; i++)
+		e->payload[i] = buffer[i];
+	e->len = data_c;
+	e->match = match;
+}
+
+/**
+ * Instructions a consist address carries: speed and direction, and the
+ * function groups enabled by CV#21/22. The others only act on the decoder's
+ * own address.
+ */
+static bool consist_instr(uint8_t instr)
+{
+	switch (instr & 0xe0u) {
+	case DCC_SDIR:
+	case DCC_SDIF:
+	case DCC_FG1I:
+	case DCC_FG2I:
+		return true;
+	case DCC_AOI:
+		return (instr & 0x1fu) == 0x1f;
+	default:
+		return false;
+	}
 }
 
 uint8_t decode(const uint8_t *buffer, uint8_t len, uint8_t check)
 {
-	unsigned char parse = 0;
+	uint8_t match = DCC_ADDR_OTHER;
 
 	if (len < 3) {
 		return DCC_ERROR;
@@ -173,10 +466,10 @@ uint8_t decode(const uint8_t *buffer, uint8_t len, uint8_t check)
 		return DCC_ERROR;
 	}
 
-	uint16_t address = 0;
+	uint16_t key;
 
 	if (*buffer == DCC_BROADCAST) {
-		parse = 1;
+		match = DCC_ADDR_OWN;
 		buffer++;
 	} else if (*buffer == DCC_IDLEADDR) {
 		return DCC_IDLE;
@@ -184,23 +477,46 @@ uint8_t decode(const uint8_t *buffer, uint8_t len, uint8_t check)
 		/**
 		 * If address starts with 11, a second address byte must follow
 		 */
-		if (*buffer & 0xc0u) { // 2-byte address
-			address = (*buffer++ & 0x3fu) << 8u;
-			address |= *buffer++;
+		if ((*buffer & 0xc0u) == 0xc0u) { // 2-byte address
+			key = DCC_ADDR_LONG | (*buffer++ & 0x3fu) << 8u;
+			key |= *buffer++;
 			data_c--;
 			if (data_c == 0) {
 				return DCC_ERROR;
 			}
 		} else {        // 1-byte address
-			address |= *buffer++;
+			key = *buffer++;
 		}
 
-		if (address == DCC_ADDRESS) {
-			parse = 1;
-		}
+		match = dcc_addr_match(key);
 	}
 
-	if (parse) {
+	if (match == DCC_ADDR_CONSIST && !consist_instr(*buffer))
+		return DCC_IGNORE;
+
+	if (match != DCC_ADDR_OTHER) {
+		const struct dcc_addr_mode *mode = &addr1.mode[match];
+		const uint8_t *payload = buffer;
+		uint8_t slot = dcc_cache_slot(buffer, data_c);
+		uint8_t data;
+
+		wd_packet();
+
+		/* 1110CCVV, long form CV access */
+		if ((*buffer & 0xf0u) != DCC_CVAI)
+			dcc_cv_acc_end();
+
+		if (slot == DCC_CACHE_BYPASS) {
+			dcc_cache_stats.bypassed++;
+			dcc_cache_flush();
+		} else if (slot != DCC_CACHE_NONE) {
+			if (dcc_cache_hit(slot, payload, data_c, match)) {
+				dcc_cache_stats.hits++;
+				return DCC_OK;
+			}
+			dcc_cache_stats.misses++;
+		}
+
 		uint8_t instr  = *buffer++;
 		uint8_t i_type = instr & 0xe0u;
 		uint8_t sub_i;
@@ -222,7 +538,10 @@ uint8_t decode(const uint8_t *buffer, uint8_t len, uint8_t check)
 				sub_i = instr & 0x1fu;
 				switch (sub_i) {
 					case 0x1f:
-						if (dcc_128_speed(buffer, data_c)) {
+						/* Bit 7 is the direction */
+						data = *buffer ^
+						       (mode->reverse ? 0x80u : 0);
+						if (dcc_128_speed(&data, data_c)) {
 							return DCC_ERROR;
 						}
 						break;
@@ -243,13 +562,15 @@ uint8_t decode(const uint8_t *buffer, uint8_t len, uint8_t check)
 				break;
 			case DCC_SDIR:
 			case DCC_SDIF:
-				dcc_vel_dir(instr);
+				dcc_vel_dir(mode->reverse ? instr ^ 0x20u : instr,
+					    mode->fg1);
 				break;
 			case DCC_FG1I:
-				dcc_fun_g1(instr);
+				dcc_fun_g1(instr, mode->fg1);
 				break;
 			case DCC_FG2I:
-				dcc_fun_g2(instr);
+				dcc_fun_g2(instr, (instr & 0x10u) ?
+					   mode->f5_8 : mode->f9_12);
 				break;
 			case DCC_FE:
 				/* Feature Expansion Instruction */
@@ -290,6 +611,10 @@ uint8_t decode(const uint8_t *buffer, uint8_t len, uint8_t check)
 			default:
 				break;
 		}
+
+		/* Only once the handler accepted it */
+		if (slot < DCC_CACHE_SLOTS)
+			dcc_cache_store(slot, payload, data_c, match);
 	} else {
 		return DCC_IGNORE;
 	}
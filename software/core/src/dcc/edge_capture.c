@@ -0,0 +1,79 @@
+/*******************************************************************************
+ * @file    :   edge_capture.c
+ * @brief   :   Timestamp ring between the DCC edge interrupt and the receiver
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "edge_capture.h"
+#include "decoder.h"
+#include "clock.h"
+
+struct edge_ring er1 = { .sync = true };
+
+RAMFUNC void edge_drain(void)
+{
+	uint8_t head = er1.head;
+	uint8_t edges;
+	uint32_t start;
+
+	if ((uint8_t) (head - er1.tail) > EDGE_RING_LEN) {
+		/* The consumer fell behind and edges were overwritten */
+		er1.overruns++;
+		er1.tail = head;
+		er1.sync = true;
+		decoder_reset(&dec1);
+		return;
+	}
+
+	if (er1.gap) {
+		/* Edges older than a timer period can't be told apart */
+		er1.gap = false;
+		er1.sync = true;
+		decoder_reset(&dec1);
+	}
+
+	er1.batches++;
+	edges = head - er1.tail;
+	start = SysTick->VAL;
+
+	while (er1.tail != head) {
+		uint16_t ts = er1.ts[++er1.tail & (EDGE_RING_LEN - 1)];
+		uint16_t prev = er1.prev;
+
+		/* Already the current edge for the receiver, see decoder_end() */
+		er1.prev = ts;
+
+		if (er1.sync) {
+			er1.sync = false;
+		} else {
+			/* Modular difference: the counter wraps at 65535 */
+			interrupt_funct(ts - prev);
+		}
+	}
+
+	if (edges)
+		clock_edges(clock_cycles(start), edges);
+}
+
+void edge_timer_update(void)
+{
+	uint8_t head = er1.head;
+
+	/**
+	 * No edge since the previous update: the next one is more than a full
+	 * period apart and its difference would wrap around.
+	 */
+	if (head == er1.update_head) {
+		er1.gap = true;
+		rx_stats.gaps++;
+		if (er1.idle_periods < 255)
+			er1.idle_periods++;
+	} else {
+		er1.idle_periods = 0;
+	}
+	er1.update_head = head;
+
+	SCB->ICSR = SCB_ICSR_PENDSVSET_Msk;
+}
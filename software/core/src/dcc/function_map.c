@@ -0,0 +1,160 @@
+/*******************************************************************************
+ * @file    :   function_map.c
+ * @brief   :   Function to output mapping, CV#33 -> CV#46
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "function_map.h"
+#include "lights.h"
+#include "cv.h"
+#include "decoder.h"
+
+/**
+ * The output locations are compiled into one lookup table per function
+ * group, indexed by the state bits of the group: an entry is the set of
+ * output pins on, as light_output_word(). A state change is then three loads
+ * and one BSRR write per port.
+ */
+
+#define CV_OUTPUT_FIRST		33
+#define CV_OUTPUT_LAST		46
+
+/* Functions in CV order: FL(f), FL(r), F1 -> F12 */
+#define FN_FLF			0
+#define FN_FLR			1
+#define FN_F(n)			((n) + 1)
+#define FN_COUNT		(CV_OUTPUT_LAST - CV_OUTPUT_FIRST + 1)
+
+/* Indexed by [reverse][FL F4 F3 F2 F1] */
+static uint32_t lut_g1[2][32];
+static uint32_t lut_f5_8[16];
+static uint32_t lut_f9_12[16];
+
+static struct {
+	uint8_t g1;		/* FL F4 F3 F2 F1 */
+	uint8_t f5_8;
+	uint8_t f9_12;
+	bool reverse;
+	bool fl_in_g1;		/* CV#29 bit 1 */
+} fn1;
+
+struct fn_stats fn_stats;
+
+/**
+ * Output pins of function fn. CV#33 -> CV#37 map to outputs 1 -> 8,
+ * CV#38 -> CV#42 to 4 -> 11, CV#43 -> CV#46 to 7 -> 14.
+ */
+static uint32_t function_word(uint8_t fn)
+{
+	uint16_t mask = read_cv(CV_OUTPUT_FIRST + fn);
+	uint32_t word = 0;
+
+	if (fn >= 10)
+		mask <<= 6;
+	else if (fn >= 5)
+		mask <<= 3;
+
+	for (uint8_t out = 0; out < LIGHT_OUTPUTS; out++)
+		if (mask & (1u << out))
+			word |= light_output_word(out);
+
+	return word;
+}
+
+/* Each entry adds the lowest state bit to an entry already built */
+static void build(uint32_t *lut, const uint32_t *word, uint8_t bits)
+{
+	lut[0] = 0;
+	for (uint8_t i = 1; i < (1u << bits); i++)
+		lut[i] = lut[i & (i - 1)] | word[__builtin_ctz(i)];
+}
+
+static void fn_apply(void)
+{
+	uint32_t on = lut_g1[fn1.reverse][fn1.g1] | lut_f5_8[fn1.f5_8] |
+		      lut_f9_12[fn1.f9_12];
+
+	light_outputs(on);
+	fn_stats.updates++;
+}
+
+void fn_map_update(uint16_t num)
+{
+	uint32_t word[FN_COUNT];
+	uint32_t g1[5];
+	bool swap;
+
+	if (num != 0 && num != 29 &&
+	    (num < CV_OUTPUT_FIRST || num > CV_OUTPUT_LAST))
+		return;
+
+	for (uint8_t fn = 0; fn < FN_COUNT; fn++)
+		word[fn] = function_word(fn);
+
+	/* CV#29 bit 0 swaps the front and rear lights with the motor */
+	swap = read_cv(29) & 0x01u;
+	fn1.fl_in_g1 = read_cv(29) & 0x02u;
+
+	for (uint8_t n = 1; n <= 4; n++)
+		g1[n - 1] = word[FN_F(n)];
+	g1[4] = word[swap ? FN_FLR : FN_FLF];
+	build(lut_g1[0], g1, 5);
+	g1[4] = word[swap ? FN_FLF : FN_FLR];
+	build(lut_g1[1], g1, 5);
+
+	build(lut_f5_8, &word[FN_F(5)], 4);
+	build(lut_f9_12, &word[FN_F(9)], 4);
+
+	fn_apply();
+}
+
+void fn_group1(uint8_t fun, uint8_t mask)
+{
+	if (!fn1.fl_in_g1)
+		mask &= 0x0fu;
+
+	fn1.g1 = (fn1.g1 & ~mask) | (fun & mask & 0x1fu);
+
+	fn_apply();
+}
+
+void fn_group2(uint8_t fun, uint8_t mask)
+{
+	mask &= 0x0fu;
+
+	/* 1011DDDD: F5-F8, 1010DDDD: F9-F12 */
+	if (fun & 0x10u)
+		fn1.f5_8 = (fn1.f5_8 & ~mask) | (fun & mask);
+	else
+		fn1.f9_12 = (fn1.f9_12 & ~mask) | (fun & mask);
+
+	fn_apply();
+}
+
+void fn_light(bool on)
+{
+	if (on == !!(fn1.g1 & 0x10u))
+		return;
+
+	fn1.g1 ^= 0x10u;
+	fn_apply();
+}
+
+void fn_direction(bool reverse)
+{
+	if (reverse == fn1.reverse)
+		return;
+
+	fn1.reverse = reverse;
+	fn_apply();
+
+	/* A cached FL may now be allowed, or not, on the consist address */
+	dcc_cache_flush();
+}
+
+bool fn_reverse(void)
+{
+	return fn1.reverse;
+}
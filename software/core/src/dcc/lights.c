@@ -0,0 +1,252 @@
+/*******************************************************************************
+ * @file    :   lights.c
+ * @brief   :   Function outputs and their lighting effects
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "lights.h"
+#include "cv.h"
+#include "main.h"
+
+/**
+ * Steady outputs at full brightness are written straight to BSRR when the
+ * function state changes. The others are played from a table of BSRR words,
+ * one per PWM slot and port: the TIM21 channel 1 compare writes the words of
+ * a slot and moves to the next, so the six channels cost one short interrupt
+ * per slot whatever their duties, and none when no output needs it.
+ *
+ * The effects run once per motor tick, in the main loop like light_outputs(),
+ * and only rewrite the slots between the old and the new duty of an output.
+ */
+
+/* Periodic effects repeat every 128 ticks, 0.9 s */
+#define LIGHT_PHASE_TICKS	128
+#define FADE_TICKS		2	/* per duty slot */
+#define FLICKER_TICKS		4
+#define STROBE_TICKS		6	/* length of a flash */
+#define STROBE2_TICKS		20	/* start of the second flash */
+
+/* Output locations 1 -> 6 */
+static const struct {
+	GPIO_TypeDef *port;
+	uint16_t pin;
+} outputs[LIGHT_OUTPUTS] = {
+	{ C_FOF_GPIO_Port, C_FOF_Pin },		/* front light, forward */
+	{ C_FOR_GPIO_Port, C_FOR_Pin },		/* front light, reverse */
+	{ C_GPIOA_GPIO_Port, C_GPIOA_Pin },
+	{ C_GPIOB_GPIO_Port, C_GPIOB_Pin },
+	{ C_AUX1_GPIO_Port, C_AUX1_Pin },
+	{ C_AUX2_GPIO_Port, C_AUX2_Pin },
+};
+
+/* BSRR words of GPIOA and GPIOB for every slot */
+static struct {
+	uint32_t a, b;
+} pattern[LIGHT_SLOTS];
+
+static struct {
+	volatile uint32_t on;	/* last light_outputs() */
+	uint32_t played;	/* pins of the outputs in the pattern */
+	uint32_t steady;	/* pins written by light_outputs() */
+	uint8_t slot;
+	uint8_t phase;
+	uint16_t lfsr;
+	uint8_t effect[LIGHT_OUTPUTS];
+	uint8_t bright[LIGHT_OUTPUTS];	/* duty when on, in slots */
+	uint8_t duty[LIGHT_OUTPUTS];	/* in the pattern */
+} light1 = {
+	.lfsr = 0xace1u,
+};
+
+struct light_stats light_stats;
+
+uint32_t light_output_word(uint8_t out)
+{
+	uint32_t pin = outputs[out].pin;
+
+	return (outputs[out].port == GPIOA) ? pin : pin << 16;
+}
+
+/* Moves the duty of out in the pattern, one slot at a time */
+static void light_patch(uint8_t out, uint8_t duty)
+{
+	uint32_t word = light_output_word(out);
+	uint32_t a = word & 0xffffu;
+	uint32_t b = word >> 16;
+	uint8_t s = light1.duty[out];
+
+	for (; s < duty; s++) {
+		pattern[s].a = (pattern[s].a & ~(a << 16)) | a;
+		pattern[s].b = (pattern[s].b & ~(b << 16)) | b;
+		light_stats.patches++;
+	}
+	for (; s > duty; s--) {
+		pattern[s - 1].a = (pattern[s - 1].a & ~a) | (a << 16);
+		pattern[s - 1].b = (pattern[s - 1].b & ~b) | (b << 16);
+		light_stats.patches++;
+	}
+
+	light1.duty[out] = duty;
+}
+
+static uint8_t random8(void)
+{
+	uint16_t r = light1.lfsr;
+
+	r = (r >> 1) ^ (-(r & 1u) & 0xb400u);
+	light1.lfsr = r;
+
+	return r;
+}
+
+/* Duty of out for this tick */
+static uint8_t light_level(uint8_t out, bool on)
+{
+	uint8_t b = light1.bright[out];
+	uint8_t d = light1.duty[out];
+	uint8_t phase = light1.phase;
+	uint8_t target, x;
+
+	switch (light1.effect[out]) {
+	case LIGHT_FADE:
+		target = on ? b : 0;
+		if (phase % FADE_TICKS)
+			return d;
+		return d + (d < target) - (d > target);
+	case LIGHT_FLICKER:
+		if (!on)
+			return 0;
+		if (d != 0 && (phase % FLICKER_TICKS))
+			return d;
+		/* Random between half and full brightness */
+		return b - ((random8() * (b / 2 + 1)) >> 8);
+	case LIGHT_STROBE:
+		return (on && phase < STROBE_TICKS) ? b : 0;
+	case LIGHT_DOUBLE_STROBE:
+		return (on && (phase < STROBE_TICKS ||
+			       (uint8_t) (phase - STROBE2_TICKS) < STROBE_TICKS))
+		       ? b : 0;
+	case LIGHT_MARS:
+		if (!on)
+			return 0;
+		/* A quarter of the brightness plus a parabola over the period */
+		x = (phase < LIGHT_PHASE_TICKS / 2) ? phase :
+		    LIGHT_PHASE_TICKS - 1 - phase;
+		return b / 4 + (((b - b / 4) * x * x) >> 12);
+	case LIGHT_DITCH_A:
+	case LIGHT_DITCH_B:
+		return (on && (phase < LIGHT_PHASE_TICKS / 2) ==
+			(light1.effect[out] == LIGHT_DITCH_A)) ? b : 0;
+	default:
+		return on ? b : 0;
+	}
+}
+
+_Static_assert(LIGHT_PHASE_TICKS / 2 <= 64, "light_level(): x * x < 4096");
+
+void light_update(uint16_t num)
+{
+	uint32_t played = 0;
+	uint32_t all = 0;
+
+	if (num != 0 && (num < CV_LIGHT_EFFECT ||
+			 num >= CV_LIGHT_BRIGHTNESS + LIGHT_OUTPUTS))
+		return;
+
+	__disable_irq();
+
+	for (uint8_t out = 0; out < LIGHT_OUTPUTS; out++) {
+		uint8_t effect = read_cv(CV_LIGHT_EFFECT + out);
+		uint8_t bright = ((uint16_t) read_cv(CV_LIGHT_BRIGHTNESS + out) *
+				  LIGHT_SLOTS + 127) / 255;
+
+		light1.effect[out] = (effect < LIGHT_EFFECTS) ? effect : 0;
+		light1.bright[out] = bright;
+		light1.duty[out] = 0;
+
+		all |= light_output_word(out);
+		if (effect != LIGHT_STEADY || bright < LIGHT_SLOTS)
+			played |= light_output_word(out);
+	}
+
+	/* The pattern restarts from all off, the next tick fills it */
+	for (uint8_t s = 0; s < LIGHT_SLOTS; s++) {
+		pattern[s].a = played << 16;
+		pattern[s].b = played & 0xffff0000u;
+	}
+	light1.played = played;
+	light1.steady = all & ~played;
+
+	if (played)
+		TIM21->DIER |= TIM_DIER_CC1IE;
+	else
+		TIM21->DIER &= ~TIM_DIER_CC1IE;
+
+	__enable_irq();
+
+	light_outputs(light1.on);
+}
+
+void light_outputs(uint32_t on)
+{
+	uint32_t steady = light1.steady;
+
+	light1.on = on;
+
+	/* Set has priority over reset in BSRR */
+	GPIOA->BSRR = (steady << 16) | (on & steady & 0xffffu);
+	GPIOB->BSRR = (steady & 0xffff0000u) | ((on & steady) >> 16);
+	light_stats.port_writes += 2;
+}
+
+void light_tick(void)
+{
+	uint32_t on = light1.on;
+
+	if (light1.played == 0)
+		return;
+
+	light1.phase = (light1.phase + 1) & (LIGHT_PHASE_TICKS - 1);
+
+	for (uint8_t out = 0; out < LIGHT_OUTPUTS; out++) {
+		uint32_t word = light_output_word(out);
+		uint8_t duty;
+
+		if (!(light1.played & word))
+			continue;
+
+		duty = light_level(out, on & word);
+		if (duty != light1.duty[out])
+			light_patch(out, duty);
+	}
+}
+
+void light_slot(void)
+{
+	uint8_t s = light1.slot;
+
+	GPIOA->BSRR = pattern[s].a;
+	GPIOB->BSRR = pattern[s].b;
+
+	if (++s == LIGHT_SLOTS)
+		s = 0;
+	light1.slot = s;
+	TIM21->CCR1 = s * LIGHT_SLOT_US;
+
+	light_stats.slots++;
+}
+
+bool light_idle(void)
+{
+	if (light1.on & light1.played)
+		return false;
+
+	/* Still fading out */
+	for (uint8_t out = 0; out < LIGHT_OUTPUTS; out++)
+		if (light1.duty[out] != 0)
+			return false;
+
+	return true;
+}
@@ -0,0 +1,231 @@
+/*******************************************************************************
+ * @file    :   motor.c
+ * @brief   :   Momentum engine and motor PWM on TIM22
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "motor.h"
+#include "speed_table.h"
+#include "bemf.h"
+#include "cv.h"
+#include "main.h"
+
+/**
+ * The motor bridge is driven in slow decay: one input is held high and the
+ * other one is PWM, the motor being braked while both are high. Going forward
+ * TIM22 CH1 (IN_1) is forced active and CH2 (IN_2) is PWM, reverse swaps them.
+ * The compare value is then the braking part of the period, MOTOR_PWM_TOP
+ * minus the duty of the current step in speed_lut[], as corrected by the back
+ * EMF controller. Both inputs low leave the outputs floating, for the back
+ * EMF windows.
+ */
+#define OCM_FORCED_INACTIVE	TIM_CCMR1_OC1M_2
+#define OCM_FORCED_ACTIVE	(TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_0)
+#define OCM_PWM1		(TIM_CCMR1_OC1M_2 | TIM_CCMR1_OC1M_1)
+#define OC2M_SHIFT		8
+
+struct motor {
+	volatile uint16_t target;	/* 8.8 steps */
+	volatile bool target_reverse;
+	uint16_t speed;			/* 8.8 steps, output of the ramp */
+	bool reverse;			/* direction of speed */
+	uint8_t frac;			/* ramp remainder below 1/256 step */
+	uint16_t accel, decel;		/* 1/65536 step per tick, 0: no momentum */
+	bool flip;			/* CV#29 bit 0, reverse normal direction */
+	uint8_t kick;			/* ticks of kick start left */
+	bool pulse;			/* service mode ACK owns the bridge */
+};
+
+static struct motor mot1;
+
+struct motor_stats motor_stats;
+
+/**
+ * CV#3 * 0.896 s from stop to full speed: (MOTOR_STEPS << 8) / (CV * 128)
+ * 8.8 steps per tick, i.e. (MOTOR_STEPS << 9) / CV in 1/65536 steps. The only
+ * divisions, done when the CVs change.
+ */
+static uint16_t motor_rate(uint8_t cv)
+{
+	if (cv == 0)
+		return 0;
+
+	return ((uint32_t) MOTOR_STEPS << 9) / cv;
+}
+
+void motor_config(void)
+{
+	uint16_t accel = motor_rate(read_cv(3));
+	uint16_t decel = motor_rate(read_cv(4));
+	bool flip = read_cv(29) & 0x01u;
+
+	__disable_irq();
+	mot1.accel = accel;
+	mot1.decel = decel;
+	mot1.flip = flip;
+	__enable_irq();
+}
+
+void motor_set(uint8_t step, bool reverse)
+{
+	if (step > MOTOR_STEPS)
+		step = MOTOR_STEPS;
+
+	__disable_irq();
+	mot1.target = (uint16_t) step << 8;
+	mot1.target_reverse = reverse ^ mot1.flip;
+	__enable_irq();
+}
+
+void motor_stop(void)
+{
+	__disable_irq();
+	mot1.target = 0;
+	__enable_irq();
+}
+
+void motor_estop(void)
+{
+	__disable_irq();
+	mot1.target = 0;
+	mot1.speed = 0;
+	mot1.frac = 0;
+	mot1.kick = 0;
+	__enable_irq();
+}
+
+bool motor_idle(void)
+{
+	return mot1.speed == 0 && mot1.target == 0;
+}
+
+/**
+ * Moves speed toward target by rate per tick. The part of the rate below
+ * 1/256 step accumulates in frac, so even CV = 255 keeps moving.
+ */
+static uint16_t motor_ramp(struct motor *m, uint16_t target, uint16_t rate)
+{
+	uint16_t delta;
+
+	if (rate == 0)
+		return target;
+
+	delta = (rate + m->frac) >> 8;
+	m->frac = rate + m->frac;
+
+	if (m->speed < target)
+		return (target - m->speed > delta) ? m->speed + delta : target;
+
+	return (m->speed - target > delta) ? m->speed - delta : target;
+}
+
+static void motor_output(struct motor *m)
+{
+	uint8_t step = m->speed >> 8;
+	uint8_t duty = bemf_adjust(speed_lut[step], step);
+	uint32_t ccmr = TIM22->CCMR1 & ~(TIM_CCMR1_OC1M | TIM_CCMR1_OC2M);
+
+	if (m->kick) {
+		m->kick--;
+		if (duty < speed_kick)
+			duty = speed_kick;
+	}
+
+	if (m->reverse) {
+		TIM22->CCMR1 = ccmr | OCM_PWM1 |
+			       (OCM_FORCED_ACTIVE << OC2M_SHIFT);
+		TIM22->CCR1 = MOTOR_PWM_TOP - duty;
+	} else {
+		TIM22->CCMR1 = ccmr | OCM_FORCED_ACTIVE |
+			       (OCM_PWM1 << OC2M_SHIFT);
+		TIM22->CCR2 = MOTOR_PWM_TOP - duty;
+	}
+}
+
+static void motor_coast(void)
+{
+	uint32_t ccmr = TIM22->CCMR1 & ~(TIM_CCMR1_OC1M | TIM_CCMR1_OC2M);
+
+	TIM22->CCMR1 = ccmr | OCM_FORCED_INACTIVE |
+		       (OCM_FORCED_INACTIVE << OC2M_SHIFT);
+}
+
+uint8_t motor_step(void)
+{
+	return mot1.speed >> 8;
+}
+
+void motor_resume(void)
+{
+	if (!mot1.pulse)
+		motor_output(&mot1);
+}
+
+void motor_pulse(bool on)
+{
+	uint32_t ccmr = TIM22->CCMR1 & ~(TIM_CCMR1_OC1M | TIM_CCMR1_OC2M);
+
+	mot1.pulse = on;
+
+	/* Full forward drive, IN_1 high and IN_2 low */
+	if (on)
+		TIM22->CCMR1 = ccmr | OCM_FORCED_ACTIVE |
+			       (OCM_FORCED_INACTIVE << OC2M_SHIFT);
+	else
+		motor_output(&mot1);
+}
+
+/**
+ * Runs in the TIM21 interrupt, with no division: a few compares, the ramp
+ * addition and one load from speed_lut[] for the duty.
+ */
+void motor_tick(void)
+{
+	struct motor *m = &mot1;
+	uint32_t start = SysTick->VAL;
+	uint32_t cycles;
+	uint16_t target = m->target;
+
+	/* Down to 0 before reversing */
+	if (m->reverse != m->target_reverse) {
+		if (m->speed == 0)
+			m->reverse = m->target_reverse;
+		else
+			target = 0;
+	}
+
+	if (m->speed < target) {
+		if (m->speed == 0)
+			m->kick = SPEED_KICK_TICKS;
+		m->speed = motor_ramp(m, target, m->accel);
+	}
+	else if (m->speed > target)
+		m->speed = motor_ramp(m, target, m->decel);
+	else
+		m->frac = 0;
+
+	/* A window takes under a millisecond: still open means no conversion */
+	if (bemf_busy())
+		bemf_cancel();
+
+	if (m->pulse) {
+		/* Left alone until the ACK ends */
+	} else if (bemf_due(m->speed >> 8)) {
+		motor_coast();
+		bemf_start();
+	} else {
+		motor_output(m);
+	}
+
+	/* SysTick counts down and reloads every millisecond */
+	cycles = start - SysTick->VAL;
+	if ((int32_t) cycles < 0)
+		cycles += SysTick->LOAD + 1;
+
+	motor_stats.ticks++;
+	motor_stats.tick_cycles = cycles;
+	if (cycles > motor_stats.tick_cycles_max)
+		motor_stats.tick_cycles_max = cycles;
+}
@@ -0,0 +1,59 @@
+/*******************************************************************************
+ * @file    :   packet_queue.c
+ * @brief   :   Lock-free queue of the packets received by the bit receiver
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "packet_queue.h"
+#include "main.h"
+
+#include <stddef.h>
+
+/* From the receiver, in RAM with it: no memcpy(), which stays in flash */
+RAMFUNC bool pq_push(struct packet_queue *q, const uint8_t *bytes,
+		     uint8_t len, uint16_t end)
+{
+	uint8_t head = q->head;
+	uint8_t depth = head - q->tail;
+
+	if (depth >= PACKET_QUEUE_LEN || len > DCC_PACKET_MAX) {
+		q->overflows++;
+		return false;
+	}
+
+	struct dcc_packet *p = &q->slot[head & (PACKET_QUEUE_LEN - 1)];
+
+	for (uint8_t i = 0; i < len; i++)
+		p->bytes[i] = bytes[i];
+	p->len = len;
+	p->end = end;
+
+	if (depth + 1 > q->max_depth)
+		q->max_depth = depth + 1;
+
+	/* The slot must be complete before the consumer can see it */
+	__DMB();
+	q->head = head + 1;
+
+	return true;
+}
+
+const struct dcc_packet *pq_peek(struct packet_queue *q)
+{
+	uint8_t tail = q->tail;
+
+	if (tail == q->head)
+		return NULL;
+
+	__DMB();
+	return &q->slot[tail & (PACKET_QUEUE_LEN - 1)];
+}
+
+void pq_pop(struct packet_queue *q)
+{
+	/* Done reading the slot before handing it back to the producer */
+	__DMB();
+	q->tail++;
+}
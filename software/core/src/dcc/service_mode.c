@@ -0,0 +1,261 @@
+/*******************************************************************************
+ * @file    :   service_mode.c
+ * @brief   :   Service mode (S-9.2.3): direct mode CV access and ACK pulse
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "service_mode.h"
+#include "decoder.h"
+#include "motor.h"
+#include "cv.h"
+#include "main.h"
+
+#include <string.h>
+
+/**
+ * SVC_ENTRY_RESETS reset packets in a row enter service mode: the motor stops
+ * and the receiver lets through the 0111xxxx packets of the programming
+ * track, which on the main are addresses 112-127. Command stations send at
+ * least three before any instruction; a lone reset on the main only stops the
+ * motor. Any other packet breaks the run, and leaves service mode: those the
+ * receiver drops by address show in rx_stats.foreign and rx_stats.idle,
+ * checked on every packet seen here. The next packet cannot be dropped before
+ * its first byte, over 2 ms after the end of this one. Verifies answer on
+ * the first packet, so a bit-wise read takes one packet per bit plus the
+ * resets; writes wait for a second identical packet, as required, and are
+ * only acknowledged once in the data EEPROM: the command station may cut the
+ * power a few packets later, well within CV_COMMIT_HOLDOFF_MS.
+ *
+ * The ACK is timed from the end of the packet, not from its decoding: TIM21,
+ * which counts microseconds like TIM2, fires its channel 2 compare at
+ * end + SVC_ACK_DELAY_US to drive the motor, and SVC_ACK_US later to release
+ * it. Both run in the motor tick interrupt, so they never race with it.
+ */
+
+/* Direct mode instruction, bits 3-2 of the first byte */
+#define SVC_VERIFY_BYTE		0x04u
+#define SVC_BIT_MANIP		0x08u
+#define SVC_WRITE_BYTE		0x0cu
+
+/* Bit manipulation data: 111K DBBB */
+#define SVC_BIT_WRITE		0x10u
+#define SVC_BIT_VALUE		0x08u
+
+/* Margin for setting the compare ahead of the counter */
+#define SVC_ACK_MIN_US		10
+
+#define SVC_PACKET_LEN		4
+
+#define SVC_ENTRY_RESETS	3
+
+static struct {
+	bool active;
+	volatile bool acking;	/* ACK scheduled or running */
+	bool driving;		/* ACK running */
+	bool done;		/* last packet already acted upon */
+	volatile uint8_t periods;	/* TIM2 updates since the last packet */
+	uint8_t resets;		/* reset packets in a row */
+	uint16_t last;		/* end of the last reset or service packet */
+	uint32_t dropped;	/* rx_stats.foreign + idle at the last one */
+	uint8_t prev[SVC_PACKET_LEN];	/* last direct mode packet */
+} svc1;
+
+struct svc_stats svc_stats;
+
+static bool is_reset(const struct dcc_packet *p)
+{
+	return p->len == 3 && p->bytes[0] == 0x00 && p->bytes[1] == 0x00 &&
+	       p->bytes[2] == 0x00;
+}
+
+static void svc_enter(void)
+{
+	svc1.active = true;
+	dec1.service = true;
+	svc_stats.entries++;
+}
+
+static void svc_exit(void)
+{
+	svc1.active = false;
+	dec1.service = false;
+}
+
+/**
+ * Schedules the ACK at end + SVC_ACK_DELAY_US, converted to a TIM21 count.
+ */
+static void svc_ack(uint16_t end)
+{
+	uint16_t wait;
+	uint16_t at;
+
+	if (svc1.acking)
+		return;
+
+	__disable_irq();
+
+	wait = end + SVC_ACK_DELAY_US - TIM2->CNT;
+	if (wait > SVC_ACK_DELAY_US || wait < SVC_ACK_MIN_US) {
+		/* Decoded too late: start at once */
+		wait = SVC_ACK_MIN_US;
+		svc_stats.late++;
+	}
+
+	at = TIM21->CNT + wait;
+	if (at >= MOTOR_TICK_US)
+		at -= MOTOR_TICK_US;
+
+	TIM21->CCR2 = at;
+	TIM21->SR = ~(uint32_t) TIM_SR_CC2IF;
+	TIM21->DIER |= TIM_DIER_CC2IE;
+	svc1.acking = true;
+
+	__enable_irq();
+}
+
+void svc_timer(void)
+{
+	uint16_t at;
+
+	if (!svc1.driving) {
+		svc1.driving = true;
+		motor_pulse(true);
+		svc_stats.acks++;
+
+		at = TIM21->CCR2 + SVC_ACK_US;
+		if (at >= MOTOR_TICK_US)
+			at -= MOTOR_TICK_US;
+		TIM21->CCR2 = at;
+		return;
+	}
+
+	svc1.driving = false;
+	motor_pulse(false);
+	TIM21->DIER &= ~TIM_DIER_CC2IE;
+	svc1.acking = false;
+}
+
+void svc_timer_update(void)
+{
+	if (svc1.periods < 255)
+		svc1.periods++;
+}
+
+/* Direct mode instruction, bytes 0111CCAA AAAAAAAA DDDDDDDD */
+static void svc_direct(const struct dcc_packet *p)
+{
+	uint16_t num = (((p->bytes[0] & 0x03u) << 8) | p->bytes[1]) + 1;
+	uint8_t data = p->bytes[2];
+	bool repeat = memcmp(svc1.prev, p->bytes, SVC_PACKET_LEN) == 0;
+	uint8_t val, bit;
+
+	if (!repeat) {
+		memcpy(svc1.prev, p->bytes, SVC_PACKET_LEN);
+		svc1.done = false;
+	}
+
+	if (svc1.done)
+		return;
+
+	svc_stats.packets++;
+
+	switch (p->bytes[0] & 0x0cu) {
+	case SVC_VERIFY_BYTE:
+		svc1.done = true;
+		if (is_cv_implemented(num) && read_cv(num) == data)
+			svc_ack(p->end);
+		break;
+	case SVC_WRITE_BYTE:
+		if (!repeat)
+			break;
+		svc1.done = true;
+		if (write_cv(num, data) == CV_OP_OK &&
+		    cv_commit_flush() == CV_OP_OK) {
+			svc_stats.writes++;
+			svc_ack(p->end);
+		}
+		break;
+	case SVC_BIT_MANIP:
+		if ((data & 0xe0u) != 0xe0u || !is_cv_implemented(num))
+			break;
+
+		val = read_cv(num);
+		bit = 1u << (data & 0x07u);
+
+		if (!(data & SVC_BIT_WRITE)) {
+			svc1.done = true;
+			if (!(val & bit) == !(data & SVC_BIT_VALUE))
+				svc_ack(p->end);
+			break;
+		}
+
+		if (!repeat)
+			break;
+		svc1.done = true;
+		val = (data & SVC_BIT_VALUE) ? val | bit : val & ~bit;
+		if (write_cv(num, val) == CV_OP_OK &&
+		    cv_commit_flush() == CV_OP_OK) {
+			svc_stats.writes++;
+			svc_ack(p->end);
+		}
+		break;
+	default:
+		/* Reserved */
+		break;
+	}
+}
+
+bool svc_packet(const struct dcc_packet *p)
+{
+	uint32_t dropped;
+	uint8_t sum = 0;
+
+	for (uint8_t i = 0; i < p->len; i++)
+		sum ^= p->bytes[i];
+	if (sum != 0)
+		return svc1.active;
+
+	dropped = rx_stats.foreign + rx_stats.idle;
+	if (svc1.periods >= 2 || dropped != svc1.dropped ||
+	    (uint16_t) (p->end - svc1.last) > SVC_TIMEOUT_US) {
+		/* Not in a row with the last reset or service packet */
+		svc1.resets = 0;
+		if (svc1.active)
+			svc_exit();
+	}
+
+	if (is_reset(p)) {
+		if (svc1.resets < SVC_ENTRY_RESETS)
+			svc1.resets++;
+		if (!svc1.active) {
+			/* In service mode the motor only runs for the ACK */
+			motor_estop();
+			dcc_cache_flush();
+			if (svc1.resets == SVC_ENTRY_RESETS)
+				svc_enter();
+		}
+		/* Resets separate the instructions: the next one is new */
+		memset(svc1.prev, 0, sizeof(svc1.prev));
+		svc1.done = false;
+	} else if (!svc1.active) {
+		svc1.resets = 0;
+		return false;
+	} else if ((p->bytes[0] & 0xf0u) == 0x70u) {
+		/* Paged and register mode (3 bytes) are not supported */
+		if (p->len == SVC_PACKET_LEN)
+			svc_direct(p);
+	} else {
+		/* Any other valid packet goes back to operations mode */
+		svc1.resets = 0;
+		svc_exit();
+		return false;
+	}
+
+	svc1.last = p->end;
+	svc1.dropped = dropped;
+	svc1.periods = 0;
+
+	return true;
+}
@@ -0,0 +1,133 @@
+/*******************************************************************************
+ * @file    :   speed_table.c
+ * @brief   :   Speed step to motor duty lookup table
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "speed_table.h"
+#include "cv.h"
+
+#define CV_VSTART		2
+#define CV_VHIGH		5
+#define CV_VMID			6
+#define CV_KICK			65
+#define CV_TABLE_FIRST		67
+#define CV_TABLE_LAST		94
+
+#define TABLE_POINTS		(CV_TABLE_LAST - CV_TABLE_FIRST + 1)
+
+/* The three points of the CV#2/5/6 curve */
+#define STEP_VSTART		1
+#define STEP_VMID		(MOTOR_STEPS / 2)
+
+uint8_t speed_lut[SPEED_LUT_LEN];
+uint8_t speed_kick;
+
+/* CV#29 bit 4 the last time the table was built */
+static bool user_table;
+
+/* Internal step of point k (1 -> 28) of the speed table: k * 4.5 */
+static uint8_t point_step(uint8_t k)
+{
+	return (k * 9) >> 1;
+}
+
+/* CV value (0 -> 255) to duty */
+static uint8_t cv_duty(uint8_t val)
+{
+	return ((uint16_t) val * MOTOR_PWM_TOP + 127) / 255;
+}
+
+/**
+ * Fills the steps from s0 to s1 included, interpolating linearly between
+ * the CV values v0 and v1. The only place the curve is interpolated.
+ */
+static void fill(uint8_t s0, uint8_t v0, uint8_t s1, uint8_t v1)
+{
+	uint8_t len = s1 - s0;
+
+	for (uint8_t s = s0; s <= s1; s++) {
+		int16_t d = (int16_t) (v1 - v0) * (s - s0);
+
+		/* Rounded to nearest, so that both ends are exact */
+		if (len)
+			d = (d + ((d < 0) ? -(len / 2) : len / 2)) / len;
+		speed_lut[s] = cv_duty(v0 + d);
+	}
+}
+
+static uint8_t table_point(uint8_t k)
+{
+	return read_cv(CV_TABLE_FIRST + k - 1);
+}
+
+/* Segments on both sides of point k */
+static void build_table(uint8_t k)
+{
+	if (k <= 1)
+		fill(1, table_point(1), point_step(1), table_point(1));
+
+	for (uint8_t i = (k > 1) ? k - 1 : 1; i <= k && i < TABLE_POINTS; i++)
+		fill(point_step(i), table_point(i),
+		     point_step(i + 1), table_point(i + 1));
+}
+
+static uint8_t vhigh(void)
+{
+	uint8_t v = read_cv(CV_VHIGH);
+
+	return (v <= 1) ? 255 : v;
+}
+
+static uint8_t vmid(void)
+{
+	uint8_t v = read_cv(CV_VMID);
+
+	return (v <= 1) ? (read_cv(CV_VSTART) + vhigh()) / 2 : v;
+}
+
+static void build_curve(bool low, bool high)
+{
+	uint8_t mid = vmid();
+
+	if (low)
+		fill(STEP_VSTART, read_cv(CV_VSTART), STEP_VMID, mid);
+	if (high)
+		fill(STEP_VMID, mid, MOTOR_STEPS, vhigh());
+}
+
+void speed_table_update(uint16_t num)
+{
+	bool table = read_cv(29) & 0x10u;
+
+	if (num == 0 || (num == 29 && table != user_table)) {
+		user_table = table;
+		speed_lut[0] = 0;
+		if (table)
+			for (uint8_t k = 1; k < TABLE_POINTS; k += 2)
+				build_table(k);
+		else
+			build_curve(true, true);
+		for (uint8_t s = MOTOR_STEPS + 1; s < SPEED_LUT_LEN; s++)
+			speed_lut[s] = MOTOR_PWM_TOP;
+	}
+
+	if (num == 0 || num == CV_KICK)
+		speed_kick = cv_duty(read_cv(CV_KICK));
+
+	if (num >= CV_TABLE_FIRST && num <= CV_TABLE_LAST && user_table)
+		build_table(num - CV_TABLE_FIRST + 1);
+
+	if (user_table)
+		return;
+
+	/* Vmid follows Vstart and Vhigh while CV#6 is unset */
+	if (num == CV_VSTART)
+		build_curve(true, read_cv(CV_VMID) <= 1);
+	else if (num == CV_VHIGH)
+		build_curve(read_cv(CV_VMID) <= 1, true);
+	else if (num == CV_VMID)
+		build_curve(true, true);
+}
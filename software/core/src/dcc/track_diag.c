@@ -0,0 +1,116 @@
+/*******************************************************************************
+ * @file    :   track_diag.c
+ * @brief   :   Pulse width histogram and signal quality of the track
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "track_diag.h"
+#include "main.h"
+
+#include <string.h>
+
+/**
+ * The receiver pays for a pulse one load for its bin (from pulse_lut[], which
+ * it reads anyway, below PULSE_LUT_LEN), one increment, and a compare for the
+ * halving; a valid 1 adds the three averages, shifts and adds only. All the
+ * divisions are left to diag_cv(), in the main loop.
+ *
+ * Signal quality, CV#237 -> CV#241:
+ * 237: period of a 1, us (116 nominal)
+ * 238: jitter of the period, 1/4 us
+ * 239: asymmetry of the halves of a 1, 1/4 us
+ * 240: pulses out of every window, per mille
+ * 241: score, 100 for a clean signal, 5 points off per us of jitter or
+ *      asymmetry and 1 per 10 per mille of invalid pulses
+ */
+
+#define DIAG_PERIOD_NOMINAL	116
+
+struct diag diag1;
+
+uint8_t diag_bin_hi[DIAG_T_MAX >> 5];
+
+uint8_t diag_bin(uint16_t T)
+{
+	uint8_t octave = 0;
+
+	if (T < DIAG_T_MIN)
+		return 0;
+	if (T >= DIAG_T_MAX)
+		return DIAG_BINS - 1;
+
+	for (uint16_t t = T; t > 1; t >>= 1)
+		octave++;
+
+	/* Octave 4 is the first, then the two bits below the leading one */
+	return (octave - 4) * 4 + ((T >> (octave - 2)) & 3);
+}
+
+void diag_init(void)
+{
+	/* From 128 us up, a bin is at least 32 us wide */
+	for (uint16_t i = 0; i < (DIAG_T_MAX >> 5); i++)
+		diag_bin_hi[i] = diag_bin(i << 5);
+
+	memset(&diag1, 0, sizeof(diag1));
+	diag1.period = DIAG_PERIOD_NOMINAL << 4;
+}
+
+/* From the receiver, in RAM with it */
+RAMFUNC void diag_halve(void)
+{
+	for (uint8_t i = 0; i < DIAG_BINS; i++)
+		diag1.hist[i] >>= 1;
+
+	diag1.invalid >>= 1;
+	diag1.pulses = 0x8000u;
+}
+
+static uint16_t diag_permille(void)
+{
+	if (diag1.pulses == 0)
+		return 0;
+
+	return (uint32_t) diag1.invalid * 1000 / diag1.pulses;
+}
+
+static uint8_t diag_score(void)
+{
+	int16_t score = 100;
+
+	score -= 5 * ((diag1.jitter + 8) >> 4);
+	score -= 5 * ((diag1.asym + 8) >> 4);
+	score -= diag_permille() / 10;
+
+	return (score < 0) ? 0 : score;
+}
+
+uint8_t diag_cv(uint16_t num)
+{
+	uint16_t idx = num - CV_DIAG_HIST;
+	uint16_t val;
+
+	if (idx < 2 * DIAG_BINS) {
+		/* High byte first */
+		val = diag1.hist[idx / 2];
+		return (idx & 1) ? val & 0xffu : val >> 8;
+	}
+
+	switch (num) {
+	case CV_DIAG_SIGNAL:
+		return (diag1.period + 8) >> 4;
+	case CV_DIAG_SIGNAL + 1:
+		return (diag1.jitter > 0x3ff) ? 255 : (diag1.jitter + 2) >> 2;
+	case CV_DIAG_SIGNAL + 2:
+		return (diag1.asym > 0x3ff) ? 255 : (diag1.asym + 2) >> 2;
+	case CV_DIAG_SIGNAL + 3:
+		val = diag_permille();
+		return (val > 255) ? 255 : val;
+	case CV_DIAG_SIGNAL + 4:
+		return diag_score();
+	default:
+		return 0;
+	}
+}
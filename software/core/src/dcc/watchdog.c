@@ -0,0 +1,75 @@
+/*******************************************************************************
+ * @file    :   watchdog.c
+ * @brief   :   Packet time-out (CV#11) and loss of the DCC signal
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "watchdog.h"
+#include "edge_capture.h"
+#include "decoder.h"
+#include "motor.h"
+#include "cv.h"
+#include "main.h"
+
+/**
+ * Nothing runs per edge: decode() clears the count for each packet of ours,
+ * the TIM2 update (every 65.536 ms) increments it, and the main loop, woken
+ * up by that update, compares it with CV#11.
+ *
+ * DC is told from the edges: a DCC signal has one at least every 12 ms, so a
+ * few TIM2 periods without any while the input reads high mean a steady
+ * polarity on the rails. With the opposite polarity the input reads low, like
+ * with the track dead and the decoder running from its capacitors: both are
+ * left to CV#11. Analog operation (CV#29 bit 2) is not supported, so DC
+ * stops the motor whatever CV#11 holds.
+ */
+
+struct watchdog wd1;
+struct wd_stats wd_stats;
+
+void wd_update(uint16_t num)
+{
+	if (num != 0 && num != CV_PACKET_TIMEOUT)
+		return;
+
+	/* Rounded up, at most 3891 periods */
+	wd1.timeout = ((uint32_t) read_cv(CV_PACKET_TIMEOUT) * 1000000ul +
+		       65535) >> 16;
+}
+
+void wd_timer_update(void)
+{
+	if (wd1.periods < UINT16_MAX)
+		wd1.periods++;
+}
+
+static void wd_stop(void)
+{
+	motor_stop();
+
+	/* The next refresh must run again, even if unchanged */
+	dcc_cache_flush();
+}
+
+void wd_poll(void)
+{
+	bool dc = er1.idle_periods >= WD_DC_PERIODS &&
+		  (DCC_DATA_GPIO_Port->IDR & DCC_DATA_Pin);
+
+	if (dc != wd1.dc) {
+		wd1.dc = dc;
+		if (dc) {
+			wd_stats.dc++;
+			wd_stop();
+		}
+	}
+
+	if (wd1.expired || wd1.timeout == 0 || wd1.periods < wd1.timeout)
+		return;
+
+	wd1.expired = true;
+	wd_stats.timeouts++;
+	wd_stop();
+}
@@ -0,0 +1,31 @@
+/**
+  ******************************************************************************
+  * @file    dma.c
+  * @brief   This file provides code for the configuration
+  *          of all the requested memory to memory DMA transfers.
+  ******************************************************************************
+  * @attention
+  *
+  * Copyright (c) 2022 STMicroelectronics.
+  * All rights reserved.
+  *
+  * This software is licensed under terms that can be found in the LICENSE file
+  * in the root directory of this software component.
+  * If no LICENSE file comes with this software, it is provided AS-IS.
+  *
+  ******************************************************************************
+  */
+
+#include "dma.h"
+
+/**
+  * Enable DMA controller clock
+  */
+void MX_DMA_Init(void)
+{
+	__HAL_RCC_DMA1_CLK_ENABLE();
+
+	/* DMA1_Channel1_IRQn interrupt configuration, below the DCC edges */
+	HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 2, 0);
+	HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+}
@@ -0,0 +1,51 @@
+/*******************************************************************************
+ * @file    :   latency.c
+ * @brief   :   Edge interrupt latency probe, built with LATENCY_PROBE
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "latency.h"
+
+#ifdef LATENCY_PROBE
+
+struct latency_stats latency_stats = { .min = UINT16_MAX };
+
+volatile uint32_t latency_at;
+
+/**
+ * Each sample pends EXTI line 9 from software with SysTick just read, and
+ * waits for the handler to store its own SysTick value next to the
+ * timestamp. A real edge arriving meanwhile only delays the handler, so the
+ * minimum stays the figure to compare; the maximum shows the wait behind
+ * TIM2, at the same priority: it cannot preempt, the edge is tail-chained
+ * after it.
+ */
+void latency_measure(void)
+{
+	for (uint16_t i = 0; i < LATENCY_SAMPLES; i++) {
+		uint32_t start, cycles;
+
+		latency_at = UINT32_MAX;
+		start = SysTick->VAL;
+		EXTI->SWIER = DCC_DATA_Pin;
+
+		while (latency_at == UINT32_MAX) {
+		}
+
+		/* SysTick counts down and reloads every millisecond */
+		cycles = start - latency_at;
+		if ((int32_t) cycles < 0)
+			cycles += SysTick->LOAD + 1;
+
+		latency_stats.samples++;
+		latency_stats.total += cycles;
+		if (cycles < latency_stats.min)
+			latency_stats.min = cycles;
+		if (cycles > latency_stats.max)
+			latency_stats.max = cycles;
+	}
+}
+
+#endif /* LATENCY_PROBE */
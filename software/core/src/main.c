@@ -18,12 +18,117 @@
 #include "main.h"
 #include "tim.h"
 #include "gpio.h"
+#include "dma.h"
+#include "adc.h"
 
 #include "decoder.h"
+#include "cv.h"
+#include "motor.h"
+#include "lights.h"
+#include "power.h"
+#include "watchdog.h"
+#include "clock.h"
+#include "latency.h"
 
-extern struct decoder dec1;
+/**
+ * Cooperative scheduler of the main loop. The slots run in order, each to
+ * completion, either on every pass or once every period motor ticks (7 ms,
+ * counted by sched_tick()). The last slot is power_idle(): the next interrupt
+ * starts a new pass.
+ *
+ * The motor ramp stays in the TIM21 interrupt, where the PWM update is kept
+ * in step with the back EMF windows and the service mode ACK.
+ *
+ * Each run is timed on TIM2. A run longer than the deadline of its task, or a
+ * periodic task released again before it could run, counts as a miss.
+ */
+#define TELEMETRY_TICKS		128	/* 0.896 s */
+
+struct task {
+	void (*run)(void);
+	uint8_t period;		/* motor ticks, 0: every pass */
+	uint16_t deadline_us;
+};
+
+static void telemetry(void);
+
+static const struct task tasks[TASKS] = {
+	[TASK_PACKETS]   = { decoder_poll, 0, 1000 },
+	[TASK_WATCHDOG]  = { wd_poll, 1, 100 },
+	[TASK_LIGHTS]    = { light_tick, 1, 500 },
+	[TASK_COMMIT]    = { cv_commit_poll, 0, 200 },
+	[TASK_CLOCK]     = { clock_trim_poll, 1, 100 },
+	[TASK_TELEMETRY] = { telemetry, TELEMETRY_TICKS, 200 },
+};
+
+static volatile uint16_t ticks;
+static uint16_t released[TASKS];	/* tick of the last release run */
+
+struct task_stats task_stats[TASKS];
+uint8_t sched_load;
+
+void sched_tick(void)
+{
+	ticks++;
+}
+
+bool sched_pending(void)
+{
+	uint16_t now = ticks;
+
+	for (uint8_t id = 0; id < TASKS; id++)
+		if (tasks[id].period &&
+		    (uint16_t) (now - released[id]) >= tasks[id].period)
+			return true;
+
+	return false;
+}
+
+static void sched_run(void)
+{
+	uint16_t now = ticks;
+
+	for (uint8_t id = 0; id < TASKS; id++) {
+		const struct task *t = &tasks[id];
+		struct task_stats *st = &task_stats[id];
+		uint16_t start, us;
+
+		if (t->period) {
+			uint16_t late = now - released[id];
+
+			if (late < t->period)
+				continue;
+			if (late >= 2 * t->period)
+				st->misses++;
+			released[id] = now;
+		}
+
+		start = TIM2->CNT;
+		t->run();
+		us = TIM2->CNT - start;
+
+		st->runs++;
+		st->run_us += us;
+		if (us > st->max_us)
+			st->max_us = us;
+		if (us > t->deadline_us)
+			st->misses++;
+	}
+}
+
+/* The only division of the loop, once per period */
+static void telemetry(void)
+{
+	static uint32_t busy_prev;
+	uint32_t busy = 0;
 
-void SystemClock_Config(void);
+	for (uint8_t id = 0; id < TASKS; id++)
+		busy += task_stats[id].run_us;
+
+	sched_load = (busy - busy_prev) * 100 /
+		     (TELEMETRY_TICKS * MOTOR_TICK_US);
+	busy_prev = busy;
+}
 
 /**
  * @brief  The application entry point.
@@ -42,16 +147,34 @@ int main(void)
 
 	/* Initialize all configured peripherals */
 	MX_GPIO_Init();
+	MX_DMA_Init();
+	MX_ADC_Init();
 
 	MX_TIM2_Init();
+	MX_TIM21_Init();
 	MX_TIM22_Init();
 
-	decoder_reset(&dec1);
+	reload_all_cvs();
+
+	decoder_init();
 
 	HAL_TIM_Base_Start_IT(&htim2);
 
-	while (1) {
+	/* Motor braked until the first speed instruction */
+	HAL_TIM_OC_Start(&htim22, TIM_CHANNEL_1);
+	HAL_TIM_PWM_Start(&htim22, TIM_CHANNEL_2);
+	HAL_TIM_Base_Start_IT(&htim21);
 
+	power_init();
+
+#ifdef LATENCY_PROBE
+	latency_measure();
+#endif
+
+	while (1) {
+		sched_run();
+		/* Power management, accounted in power_stats */
+		power_idle();
 	}
 }
 
@@ -66,15 +189,15 @@ void SystemClock_Config(void)
 
 	/** Configure the main internal regulator output voltage
 	*/
-	__HAL_PWR_VOLTAGESCALING_CONFIG(PWR_REGULATOR_VOLTAGE_SCALE1);
+	__HAL_PWR_VOLTAGESCALING_CONFIG(clock_op->voltage_scale);
 
 	/** Initializes the RCC Oscillators according to the specified parameters
 	* in the RCC_OscInitTypeDef structure.
 	*/
 	RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
-	RCC_OscInitStruct.HSIState = RCC_HSI_ON;
-	RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
-	RCC_OscInitStruct.PLL.PLLState = RCC_PLL_ON;
+	RCC_OscInitStruct.HSIState = clock_op->hsi_state;
+	RCC_OscInitStruct.HSICalibrationValue = clock_hsi_trim();
+	RCC_OscInitStruct.PLL.PLLState = clock_op->pll_state;
 	RCC_OscInitStruct.PLL.PLLSource = RCC_PLLSOURCE_HSI;
 	RCC_OscInitStruct.PLL.PLLMUL = RCC_PLLMUL_4;
 	RCC_OscInitStruct.PLL.PLLDIV = RCC_PLLDIV_2;
@@ -87,12 +210,12 @@ void SystemClock_Config(void)
 	RCC_ClkInitStruct.ClockType =
 	    RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 |
 	    RCC_CLOCKTYPE_PCLK2;
-	RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_PLLCLK;
+	RCC_ClkInitStruct.SYSCLKSource = clock_op->sysclk_source;
 	RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
 	RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
 	RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
 
-	if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_1) !=
+	if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, clock_op->flash_latency) !=
 	    HAL_OK) {
 		Error_Handler();
 	}
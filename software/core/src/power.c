@@ -0,0 +1,84 @@
+/*******************************************************************************
+ * @file    :   power.c
+ * @brief   :   Low-power idle of the main loop
+ * @author  :   Davide Campagna
+ * @date    :   Oct 18, 2026
+ * @version :   V1.0
+*******************************************************************************/
+
+#include "power.h"
+#include "main.h"
+#include "edge_capture.h"
+#include "decoder.h"
+#include "cv.h"
+#include "motor.h"
+#include "lights.h"
+
+#include <stddef.h>
+
+struct power_stats power_stats;
+
+/* TIM2 count when the core last woke up */
+static uint16_t awake_since;
+
+void power_init(void)
+{
+	/* HSI16 is the PLL source: back on the PLL within a few µs */
+	__HAL_RCC_WAKEUPSTOP_CLK_CONFIG(RCC_STOP_WAKEUPCLOCK_HSI);
+
+	/* Internal reference off in Stop, without waiting for it on wake up */
+	HAL_PWREx_EnableUltraLowPower();
+	HAL_PWREx_EnableFastWakeUp();
+
+	awake_since = TIM2->CNT;
+}
+
+/**
+ * The deepest state that keeps the receiver working is Sleep: the clocks keep
+ * running, TIM2 keeps timestamping, and the edge interrupt is taken within a
+ * few cycles of the wake up, well inside ONE_DELTA. Low-power sleep needs the
+ * system clock at 131 kHz or less, and Stop halts TIM2 and the PLL, so both
+ * would break the pulse measurement.
+ *
+ * With the track signal lost there is nothing to measure: then, once the motor
+ * has stopped and no light is dimmed or animated, the core goes to Stop, and
+ * the next DCC edge wakes it up through EXTI. The clocks are restored, the
+ * first pulses are garbage and reset the receiver, and TIM2's next update
+ * tells whether the signal came back.
+ */
+void power_idle(void)
+{
+	uint16_t now;
+
+	/* A packet queued or a task released after this check still wakes WFI */
+	__disable_irq();
+
+	if (pq_peek(&pq1) != NULL || sched_pending()) {
+		__enable_irq();
+		return;
+	}
+
+	now = TIM2->CNT;
+	power_stats.run_us += (uint16_t) (now - awake_since);
+
+	if (er1.idle_periods >= POWER_STOP_PERIODS &&
+	    er1.head == er1.update_head && cv_commit_idle() &&
+	    motor_idle() && light_idle()) {
+		power_stats.stops++;
+		HAL_SuspendTick();
+		HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON,
+				      PWR_STOPENTRY_WFI);
+		SystemClock_Config();
+		HAL_ResumeTick();
+		awake_since = TIM2->CNT;
+	} else {
+		power_stats.sleeps++;
+		HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON,
+				       PWR_SLEEPENTRY_WFI);
+		awake_since = TIM2->CNT;
+		power_stats.sleep_us += (uint16_t) (awake_since - now);
+	}
+
+	/* The interrupt that woke the core up runs here */
+	__enable_irq();
+}
@@ -24,4 +24,7 @@ void HAL_MspInit(void)
 {
 	__HAL_RCC_SYSCFG_CLK_ENABLE();
 	__HAL_RCC_PWR_CLK_ENABLE();
+
+	/* PendSV runs the DCC receiver: it must never delay an edge */
+	HAL_NVIC_SetPriority(PendSV_IRQn, 3, 0);
 }
@@ -19,8 +19,16 @@
 #include "stm32l0xx_it.h"
 
 #include "decoder.h"
+#include "edge_capture.h"
+#include "motor.h"
+#include "lights.h"
+#include "service_mode.h"
+#include "watchdog.h"
+#include "latency.h"
 
 extern TIM_HandleTypeDef htim2;
+extern TIM_HandleTypeDef htim21;
+extern DMA_HandleTypeDef hdma_adc;
 
 /******************************************************************************/
 /*           Cortex-M0+ Processor Interruption and Exception Handlers          */
@@ -54,8 +62,10 @@ void SVC_Handler(void)
 /**
   * @brief This function handles Pendable request for system service.
   */
-void PendSV_Handler(void)
+RAMFUNC void PendSV_Handler(void)
 {
+	/* Batch of captured DCC edges, at the lowest priority */
+	edge_drain();
 }
 
 /**
@@ -76,16 +86,27 @@ void SysTick_Handler(void)
 /**
   * @brief This function handles EXTI line 4 to 15 interrupts.
   */
-void EXTI4_15_IRQHandler(void)
+RAMFUNC void EXTI4_15_IRQHandler(void)
 {
-	if (DCC_DATA_GPIO_Port->IDR & DCC_DATA_Pin){
-		uint16_t val = htim2.Instance->CNT;
-		htim2.Instance->CNT = 0;
+	/* Timestamp first: TIM2 is free running, the decoder uses differences */
+	uint16_t ts = TIM2->CNT;
 
-		interrupt_funct(val);
+#ifdef LATENCY_PROBE
+	if (latency_capture()) {
+		__HAL_GPIO_EXTI_CLEAR_IT(DCC_DATA_Pin);
+		latency_release();
+		return;
 	}
+#endif
 
-	HAL_GPIO_EXTI_IRQHandler(DCC_DATA_Pin);
+	if (DCC_DATA_GPIO_Port->IDR & DCC_DATA_Pin)
+		edge_capture(ts);
+
+	__HAL_GPIO_EXTI_CLEAR_IT(DCC_DATA_Pin);
+
+#ifdef LATENCY_PROBE
+	latency_release();
+#endif
 }
 
 /**
@@ -93,8 +114,49 @@ void EXTI4_15_IRQHandler(void)
   */
 void TIM2_IRQHandler(void)
 {
-	HAL_TIM_IRQHandler(&htim2);
+	if (__HAL_TIM_GET_FLAG(&htim2, TIM_FLAG_UPDATE)) {
+		__HAL_TIM_CLEAR_IT(&htim2, TIM_IT_UPDATE);
+
+		/* Flush the edge ring and reset the receiver on signal loss */
+		edge_timer_update();
+		svc_timer_update();
+		wd_timer_update();
+	}
+}
+
+/**
+  * @brief This function handles TIM21 global interrupt.
+  */
+void TIM21_IRQHandler(void)
+{
+	if (__HAL_TIM_GET_FLAG(&htim21, TIM_FLAG_CC1) &&
+	    __HAL_TIM_GET_IT_SOURCE(&htim21, TIM_IT_CC1)) {
+		__HAL_TIM_CLEAR_IT(&htim21, TIM_IT_CC1);
+
+		light_slot();
+	}
 
-	/* Overflow: reset the receiver */
-	interrupt_funct(65535);
+	if (__HAL_TIM_GET_FLAG(&htim21, TIM_FLAG_CC2) &&
+	    __HAL_TIM_GET_IT_SOURCE(&htim21, TIM_IT_CC2)) {
+		__HAL_TIM_CLEAR_IT(&htim21, TIM_IT_CC2);
+
+		svc_timer();
+	}
+
+	if (__HAL_TIM_GET_FLAG(&htim21, TIM_FLAG_UPDATE)) {
+		__HAL_TIM_CLEAR_IT(&htim21, TIM_IT_UPDATE);
+
+		motor_tick();
+		/* The lighting effects follow in the main loop */
+		sched_tick();
+	}
+}
+
+/**
+  * @brief This function handles DMA1 channel 1 interrupt.
+  */
+void DMA1_Channel1_IRQHandler(void)
+{
+	/* End of a back EMF window, see HAL_ADC_ConvCpltCallback() */
+	HAL_DMA_IRQHandler(&hdma_adc);
 }
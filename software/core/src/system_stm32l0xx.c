@@ -101,6 +101,12 @@
 #endif /* VECT_TAB_SRAM */
 #endif /* USER_VECT_TAB_ADDRESS */
 
+#if defined(VECT_TAB_SRAM)
+/* First in RAM (.ram_vector), filled from the flash table by Reset_Handler:
+   16 system exceptions and 32 interrupts */
+__attribute__((section(".ram_vector"), used)) uint32_t ram_vector[16 + 32];
+#endif /* VECT_TAB_SRAM */
+
 /******************************************************************************/
 /**
   * @}
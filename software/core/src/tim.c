@@ -17,8 +17,10 @@
   */
 
 #include "tim.h"
+#include "clock.h"
 
 TIM_HandleTypeDef htim2;
+TIM_HandleTypeDef htim21;
 TIM_HandleTypeDef htim22;
 
 /* TIM2 init function */
@@ -28,8 +30,9 @@ void MX_TIM2_Init(void)
 	TIM_ClockConfigTypeDef sClockSourceConfig = {0};
 	TIM_MasterConfigTypeDef sMasterConfig = {0};
 
+	/* Free running 1 µs timebase for the DCC edge timestamps */
 	htim2.Instance = TIM2;
-	htim2.Init.Prescaler = 32-1;
+	htim2.Init.Prescaler = clock_op->hz / 1000000 - 1;
 	htim2.Init.CounterMode = TIM_COUNTERMODE_UP;
 	htim2.Init.Period = 65535;
 	htim2.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
@@ -50,6 +53,37 @@ void MX_TIM2_Init(void)
 	}
 }
 
+/* TIM21 init function */
+void MX_TIM21_Init(void)
+{
+	TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+	TIM_MasterConfigTypeDef sMasterConfig = {0};
+
+	/* Update every MOTOR_TICK_US (7 ms) for the momentum engine. Channels 1
+	 * and 2 stay in frozen compare mode: their interrupts pace the light PWM
+	 * slots and time the service mode ACK */
+	htim21.Instance = TIM21;
+	htim21.Init.Prescaler = clock_op->hz / 1000000 - 1;
+	htim21.Init.CounterMode = TIM_COUNTERMODE_UP;
+	htim21.Init.Period = 7000-1;
+	htim21.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+	htim21.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+	if (HAL_TIM_Base_Init(&htim21) != HAL_OK) {
+		Error_Handler();
+	}
+
+	sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+	if (HAL_TIM_ConfigClockSource(&htim21, &sClockSourceConfig) != HAL_OK) {
+		Error_Handler();
+	}
+
+	sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+	sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+	if (HAL_TIMEx_MasterConfigSynchronization(&htim21, &sMasterConfig) != HAL_OK) {
+		Error_Handler();
+	}
+}
+
 /* TIM22 init function */
 void MX_TIM22_Init(void)
 {
@@ -58,7 +92,7 @@ void MX_TIM22_Init(void)
 	TIM_OC_InitTypeDef sConfigOC = {0};
 
 	htim22.Instance = TIM22;
-	htim22.Init.Prescaler = 12-1;
+	htim22.Init.Prescaler = clock_op->pwm_prescaler - 1;
 	htim22.Init.CounterMode = TIM_COUNTERMODE_UP;
 	htim22.Init.Period = 128;
 	htim22.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
@@ -80,7 +114,8 @@ void MX_TIM22_Init(void)
 		Error_Handler();
 	}
 
-	sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+	/* The update triggers the back EMF conversions */
+	sMasterConfig.MasterOutputTrigger = TIM_TRGO_UPDATE;
 	sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
 	if (HAL_TIMEx_MasterConfigSynchronization(&htim22, &sMasterConfig) != HAL_OK) {
 		Error_Handler();
@@ -111,6 +146,12 @@ void HAL_TIM_Base_MspInit(TIM_HandleTypeDef* tim_baseHandle)
 		/* TIM2 interrupt Init */
 		HAL_NVIC_SetPriority(TIM2_IRQn, 0, 0);
 		HAL_NVIC_EnableIRQ(TIM2_IRQn);
+	} else if (tim_baseHandle->Instance == TIM21) {
+		__HAL_RCC_TIM21_CLK_ENABLE();
+
+		/* TIM21 interrupt Init, below the DCC edges */
+		HAL_NVIC_SetPriority(TIM21_IRQn, 2, 0);
+		HAL_NVIC_EnableIRQ(TIM21_IRQn);
 	} else if (tim_baseHandle->Instance == TIM22) {
 		__HAL_RCC_TIM22_CLK_ENABLE();
 	}
@@ -44,6 +44,13 @@ defined in linker script */
 .word  _sbss
 /* end address for the .bss section. defined in linker script */
 .word  _ebss
+/* load, start and end addresses of the .ramfunc section */
+.word  _siramfunc
+.word  _sramfunc
+.word  _eramfunc
+/* start and end addresses of the .ram_vector section */
+.word  _sram_vector
+.word  _eram_vector
 
     .section  .text.Reset_Handler
   .weak  Reset_Handler
@@ -68,6 +75,40 @@ LoopCopyDataInit:
   adds r4, r0, r3
   cmp r4, r1
   bcc CopyDataInit
+
+/* Copy the hot path code from flash to SRAM */
+  ldr r0, =_sramfunc
+  ldr r1, =_eramfunc
+  ldr r2, =_siramfunc
+  movs r3, #0
+  b LoopCopyRamFunc
+
+CopyRamFunc:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyRamFunc:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyRamFunc
+
+/* Copy the vector table to SRAM, where SystemInit() points VTOR */
+  ldr r0, =_sram_vector
+  ldr r1, =_eram_vector
+  ldr r2, =g_pfnVectors
+  movs r3, #0
+  b LoopCopyVector
+
+CopyVector:
+  ldr r4, [r2, r3]
+  str r4, [r0, r3]
+  adds r3, r3, #4
+
+LoopCopyVector:
+  adds r4, r0, r3
+  cmp r4, r1
+  bcc CopyVector
   
 /* Zero fill the bss segment. */
   ldr r2, =_sbss